@@ -0,0 +1,183 @@
+#include "Association.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+const size_t npos = std::numeric_limits<size_t>::max();
+
+}
+
+void HungarianSolver::solve(size_t rows, size_t columns, const std::vector<AssociationEdge> &edges,
+                            double unmatchedCost, std::vector<int> &assignment)
+{
+    assignment.assign(rows, -1);
+
+    // nodes 0..rows-1 are the rows, rows..rows+columns-1 the columns
+    _parents.resize(rows + columns);
+    std::iota(_parents.begin(), _parents.end(), 0);
+    for (const AssociationEdge &edge : edges) {
+        const size_t a = find(edge.row);
+        const size_t b = find(rows + edge.column);
+        if (a != b) {
+            _parents[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+    // components in order of their first row, so the result is deterministic
+    _index.assign(rows + columns, npos);
+    size_t count = 0;
+    for (size_t e = 0; e < edges.size(); e++) {
+        const size_t root = find(edges[e].row);
+        if (_index[root] == npos) {
+            _index[root] = count++;
+        }
+    }
+    if (_components.size() < count) {
+        _components.resize(count);
+    }
+    for (size_t c = 0; c < count; c++) {
+        _components[c].rows.clear();
+        _components[c].columns.clear();
+        _components[c].edges.clear();
+    }
+    for (size_t e = 0; e < edges.size(); e++) {
+        _components[_index[find(edges[e].row)]].edges.push_back(e);
+    }
+    for (size_t node = 0; node < rows + columns; node++) {
+        const size_t root = find(node);
+        if (_index[root] == npos) {
+            continue;
+        }
+        Component &component = _components[_index[root]];
+        if (node < rows) {
+            component.rows.push_back(node);
+        } else {
+            component.columns.push_back(node - rows);
+        }
+    }
+
+    for (size_t c = 0; c < count; c++) {
+        solveComponent(_components[c], edges, unmatchedCost, assignment);
+    }
+}
+
+// ================ P R I V A T E ===================
+
+// Rectangular Hungarian method on r rows and c + r columns: the first c are the
+// detections, column c + i is the private "unmatched" option of row i. That
+// keeps every row assignable, so blocked pairs are never chosen.
+void HungarianSolver::solveComponent(const Component &component, const std::vector<AssociationEdge> &edges,
+                                     double unmatchedCost, std::vector<int> &assignment)
+{
+    const size_t r = component.rows.size();
+    const size_t c = component.columns.size();
+    const size_t m = c + r;
+    const double blocked = 1e9 + std::abs(unmatchedCost);
+    const double infinity = std::numeric_limits<double>::infinity();
+
+    // rows and columns are distinct nodes, so one index table serves both
+    const size_t columnBase = assignment.size();
+    for (size_t i = 0; i < r; i++) {
+        _index[component.rows[i]] = i;
+    }
+    for (size_t j = 0; j < c; j++) {
+        _index[columnBase + component.columns[j]] = j;
+    }
+
+    _costs.assign(r * m, blocked);
+    for (size_t i = 0; i < r; i++) {
+        _costs[i * m + c + i] = unmatchedCost;
+    }
+    for (size_t e : component.edges) {
+        const AssociationEdge &edge = edges[e];
+        double &cost = _costs[_index[edge.row] * m + _index[columnBase + edge.column]];
+        cost = std::min(cost, edge.cost);
+    }
+
+    // 1-based with column 0 as the virtual start of each augmenting path
+    _rowPotentials.assign(r + 1, 0);
+    _columnPotentials.assign(m + 1, 0);
+    _matchedRow.assign(m + 1, 0);
+    _previous.assign(m + 1, 0);
+    for (size_t i = 1; i <= r; i++) {
+        _matchedRow[0] = i;
+        size_t column = 0;
+        _slack.assign(m + 1, infinity);
+        _visited.assign(m + 1, 0);
+        do {
+            _visited[column] = 1;
+            const size_t row = _matchedRow[column];
+            double delta = infinity;
+            size_t next = 0;
+            const double *costs = &_costs[(row - 1) * m];
+            for (size_t j = 1; j <= m; j++) {
+                if (_visited[j]) {
+                    continue;
+                }
+                const double reduced = costs[j - 1] - _rowPotentials[row] - _columnPotentials[j];
+                if (reduced < _slack[j]) {
+                    _slack[j] = reduced;
+                    _previous[j] = column;
+                }
+                if (_slack[j] < delta) {
+                    delta = _slack[j];
+                    next = j;
+                }
+            }
+            for (size_t j = 0; j <= m; j++) {
+                if (_visited[j]) {
+                    _rowPotentials[_matchedRow[j]] += delta;
+                    _columnPotentials[j] -= delta;
+                } else {
+                    _slack[j] -= delta;
+                }
+            }
+            column = next;
+        } while (_matchedRow[column] != 0);
+        do {
+            const size_t previous = _previous[column];
+            _matchedRow[column] = _matchedRow[previous];
+            column = previous;
+        } while (column != 0);
+    }
+
+    for (size_t j = 1; j <= c; j++) {
+        if (_matchedRow[j] != 0 && _costs[(_matchedRow[j] - 1) * m + j - 1] < blocked) {
+            assignment[component.rows[_matchedRow[j] - 1]] = static_cast<int>(component.columns[j - 1]);
+        }
+    }
+}
+
+size_t HungarianSolver::find(size_t node) {
+    while (_parents[node] != node) {
+        _parents[node] = _parents[_parents[node]];
+        node = _parents[node];
+    }
+    return node;
+}
+
+void GreedySolver::solve(size_t rows, size_t columns, const std::vector<AssociationEdge> &edges,
+                         double unmatchedCost, std::vector<int> &assignment)
+{
+    assignment.assign(rows, -1);
+    std::vector<char> taken(columns, 0);
+
+    _order.resize(edges.size());
+    std::iota(_order.begin(), _order.end(), 0);
+    std::stable_sort(_order.begin(), _order.end(), [&edges](size_t a, size_t b) { return edges[a].cost < edges[b].cost; });
+
+    for (size_t e : _order) {
+        const AssociationEdge &edge = edges[e];
+        if (edge.cost >= unmatchedCost) {
+            break;
+        }
+        if (assignment[edge.row] == -1 && !taken[edge.column]) {
+            assignment[edge.row] = static_cast<int>(edge.column);
+            taken[edge.column] = 1;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef ASSOCIATION_H
+#define ASSOCIATION_H
+
+#include <cstddef>
+#include <vector>
+
+// One admissible pairing of an object (row) with a detection (column). Pairs
+// outside the gate are simply not listed, so the problem stays sparse.
+struct AssociationEdge {
+    size_t row;
+    size_t column;
+    double cost;
+};
+
+// Assigns every row at most one column through one of its edges, each column
+// at most once, minimizing the summed cost. A row left unmatched costs
+// unmatchedCost. assignment[row] receives the column or -1.
+class AssociationSolver {
+public:
+    virtual ~AssociationSolver() {}
+
+    virtual void solve(size_t rows, size_t columns, const std::vector<AssociationEdge> &edges,
+                       double unmatchedCost, std::vector<int> &assignment) = 0;
+};
+
+// Optimal assignment. The gating graph is split into connected components
+// and each one is solved with the Hungarian method (shortest augmenting
+// paths), so the cost grows with the size of the largest cluster of
+// mutually reachable objects rather than with the total count.
+class HungarianSolver : public AssociationSolver {
+public:
+    void solve(size_t rows, size_t columns, const std::vector<AssociationEdge> &edges,
+               double unmatchedCost, std::vector<int> &assignment) override;
+
+private:
+    struct Component {
+        std::vector<size_t> rows;
+        std::vector<size_t> columns;
+        std::vector<size_t> edges;
+    };
+
+    void solveComponent(const Component &component, const std::vector<AssociationEdge> &edges,
+                        double unmatchedCost, std::vector<int> &assignment);
+
+    size_t find(size_t node);
+
+    std::vector<size_t>     _parents;
+    // component index per root node, later the local index of each row/column
+    std::vector<size_t>     _index;
+    std::vector<Component>  _components;
+    std::vector<double>     _costs;
+    std::vector<double>     _rowPotentials;
+    std::vector<double>     _columnPotentials;
+    std::vector<double>     _slack;
+    std::vector<size_t>     _matchedRow;
+    std::vector<size_t>     _previous;
+    std::vector<char>       _visited;
+};
+
+// Cheapest edge first. Not optimal, but linear in the number of edges after sorting.
+class GreedySolver : public AssociationSolver {
+public:
+    void solve(size_t rows, size_t columns, const std::vector<AssociationEdge> &edges,
+               double unmatchedCost, std::vector<int> &assignment) override;
+
+private:
+    std::vector<size_t> _order;
+};
+
+#endif
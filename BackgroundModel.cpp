@@ -0,0 +1,88 @@
+#include "BackgroundModel.h"
+
+namespace {
+
+class UpdateBody : public cv::ParallelLoopBody {
+public:
+    UpdateBody(const cv::Mat &frameGRAY, cv::Mat &accumulator, cv::Mat &view, double alpha, int stripes)
+        : _frameGRAY(frameGRAY)
+        , _accumulator(accumulator)
+        , _view(view)
+        , _alpha(alpha)
+        , _stripes(stripes)
+    {}
+
+    void operator()(const cv::Range &range) const override {
+        const int begin = _accumulator.rows * range.start / _stripes;
+        const int end = _accumulator.rows * range.end / _stripes;
+        cv::Mat accumulator = _accumulator.rowRange(begin, end);
+        cv::Mat view = _view.rowRange(begin, end);
+        cv::accumulateWeighted(_frameGRAY.rowRange(begin, end), accumulator, _alpha);
+        accumulator.convertTo(view, CV_8U);
+    }
+
+private:
+    const cv::Mat   &_frameGRAY;
+    cv::Mat         &_accumulator;
+    cv::Mat         &_view;
+    const double    _alpha;
+    const int       _stripes;
+};
+
+}
+
+BackgroundModel::BackgroundModel()
+    : _viewValid(false)
+{}
+
+bool BackgroundModel::isInitialized() const {
+    return !_accumulator.empty();
+}
+
+bool BackgroundModel::matches(const cv::Mat &frameGRAY) const {
+    return isInitialized() && _accumulator.size() == frameGRAY.size();
+}
+
+void BackgroundModel::reset() {
+    _accumulator.release();
+    _view.release();
+    _viewValid = false;
+}
+
+void BackgroundModel::initialize(const cv::Mat &frameGRAY) {
+    frameGRAY.convertTo(_accumulator, CV_32F);
+    _viewValid = false;
+}
+
+void BackgroundModel::restore(const cv::Mat &accumulator) {
+    accumulator.copyTo(_accumulator);
+    _viewValid = false;
+}
+
+void BackgroundModel::update(const cv::Mat &frameGRAY, float weight, size_t stripes) {
+    if (!matches(frameGRAY)) {
+        initialize(frameGRAY);
+        return;
+    }
+    if (stripes <= 1) {
+        cv::accumulateWeighted(frameGRAY, _accumulator, 1.0 - weight);
+        _viewValid = false;
+        return;
+    }
+    const int count = std::min(static_cast<int>(stripes), _accumulator.rows);
+    _view.create(_accumulator.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, count), UpdateBody(frameGRAY, _accumulator, _view, 1.0 - weight, count), count);
+    _viewValid = true;
+}
+
+const cv::Mat &BackgroundModel::view() {
+    if (!_viewValid && isInitialized()) {
+        _accumulator.convertTo(_view, CV_8U);
+        _viewValid = true;
+    }
+    return _view;
+}
+
+const cv::Mat &BackgroundModel::accumulator() const {
+    return _accumulator;
+}
@@ -0,0 +1,38 @@
+#ifndef BACKGROUND_MODEL_H
+#define BACKGROUND_MODEL_H
+
+#include <opencv2/opencv.hpp>
+
+// Running-average background kept in a persistent float accumulator, so slow
+// changes are not rounded away at high weights and no full-frame temporaries
+// are allocated per update. The 8 bit image is only materialized on request.
+class BackgroundModel {
+public:
+    BackgroundModel();
+
+    bool isInitialized() const;
+    bool matches(const cv::Mat &frameGRAY) const;
+
+    void reset();
+    void initialize(const cv::Mat &frameGRAY);
+    // continues from a copy of accumulator() taken earlier
+    void restore(const cv::Mat &accumulator);
+
+    // background = background * weight + frame * (1 - weight), in place.
+    // (re-)initializes from the frame if the model is empty or the size changed.
+    // With stripes > 1 the rows are split up and updated in parallel, and the
+    // 8 bit view is refreshed in the same pass.
+    void update(const cv::Mat &frameGRAY, float weight, size_t stripes = 1);
+
+    // 8 bit view of the accumulator, converted at most once per update
+    const cv::Mat &view();
+
+    const cv::Mat &accumulator() const;
+
+private:
+    cv::Mat _accumulator;
+    cv::Mat _view;
+    bool    _viewValid;
+};
+
+#endif
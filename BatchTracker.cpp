@@ -0,0 +1,292 @@
+// Headless batch tracker: runs the segmentation and Mapper pipeline of the
+// SimpleTracker plugin over a video or an image sequence and writes the
+// trajectories, without Qt widgets or a display.
+//
+//   simpleTracker.batch [options] <input> <output>
+//
+// input is anything cv::VideoCapture opens, e.g. a video file or an image
+// sequence pattern like frames/%06d.png. output ending in .json is written as
+// the cereal JSON archive, anything else as a binary TrajectoryFile.
+// Parameters come from a cv::FileStorage file (--config), keyed like the
+// TrackerParameters members and checked like the flags, and flags given
+// after it override them.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "OfflineTracker.h"
+#include "TrackerParameters.h"
+#include "TrajectoryFile.h"
+
+using namespace BioTracker::Core;
+
+namespace {
+
+struct Options {
+    TrackerParameters   parameters;
+    std::string         input;
+    std::string         output;
+    size_t              first;
+    size_t              end;
+    size_t              chunks;
+    size_t              overlap;
+
+    Options()
+        : first(0)
+        , end(0)
+        , chunks(0)
+        , overlap(OfflineTracker::DefaultOverlap)
+    {}
+};
+
+void printUsage(std::ostream &stream) {
+    stream << "usage: simpleTracker.batch [options] <input> <output>\n"
+              "\n"
+              "  input                  video file or image sequence pattern (frames/%06d.png)\n"
+              "  output                 .json for the JSON archive, binary trajectories otherwise\n"
+              "\n"
+              "  --config <file>        parameters from a YAML or XML file, keyed like TrackerParameters\n"
+              "  --objects <n>          number of objects\n"
+              "  --speed <px>           average speed in px per frame\n"
+              "  --polarity <p>         darker, brighter or both\n"
+              "  --min-area <px>        minimal blob area\n"
+              "  --max-area <px>        maximal blob area\n"
+              "  --erosions <n>         number of erosions\n"
+              "  --dilations <n>        number of dilations\n"
+              "  --alpha <w>            background weight, 0..1\n"
+              "  --threshold <t>        difference threshold, 0..255\n"
+              "  --promotion <n>        frames till a candidate is promoted\n"
+              "  --candidates <n>       most candidates kept at once\n"
+              "  --retention <n>        frames per track kept as poses, older ones are archived\n"
+              "                         in columns; 0 keeps everything as poses\n"
+              "  --spill <0|1>          archive to a scratch file instead of in memory\n"
+              "  --first <frame>        first frame to track\n"
+              "  --end <frame>          frame to stop at, 0 for the end of the input\n"
+              "  --chunks <n>           chunks tracked in parallel, 0 = one per cpu, 1 = serial\n"
+              "  --overlap <n>          frames tracked twice at each chunk seam\n"
+              "  --help                 this text\n";
+}
+
+bool parseSize(const std::string &text, size_t &value) {
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long long parsed = std::strtoull(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || text[0] == '-' || errno == ERANGE
+        || parsed > std::numeric_limits<size_t>::max()) {
+        return false;
+    }
+    value = static_cast<size_t>(parsed);
+    return true;
+}
+
+bool parseFlag(const std::string &text, bool &value) {
+    if (text != "0" && text != "1") {
+        return false;
+    }
+    value = text == "1";
+    return true;
+}
+
+bool parseFloat(const std::string &text, float &value) {
+    char *end = nullptr;
+    const float parsed = std::strtof(text.c_str(), &end);
+    if (text.empty() || *end != '\0') {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+bool parseThreshold(const std::string &text, uchar &value) {
+    size_t threshold;
+    if (!parseSize(text, threshold) || threshold > 255) {
+        return false;
+    }
+    value = static_cast<uchar>(threshold);
+    return true;
+}
+
+bool parsePolarity(const std::string &text, ForegroundExtractor::Polarity &polarity) {
+    if (text == "darker") {
+        polarity = ForegroundExtractor::Darker;
+    } else if (text == "brighter") {
+        polarity = ForegroundExtractor::Brighter;
+    } else if (text == "both") {
+        polarity = ForegroundExtractor::Both;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// a number node as the text a flag would carry it in, so that config values
+// go through the same checks as the flags; false for anything but a number
+bool numberText(const cv::FileNode &node, std::string &text) {
+    if (node.isInt()) {
+        text = std::to_string(static_cast<int>(node));
+    } else if (node.isReal()) {
+        std::ostringstream stream;
+        stream.precision(17);
+        stream << static_cast<double>(node);
+        text = stream.str();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool readConfig(const std::string &path, TrackerParameters &parameters) {
+    cv::FileStorage storage(path, cv::FileStorage::READ);
+    if (!storage.isOpened()) {
+        return false;
+    }
+    const cv::FileNode root = storage.root();
+    typedef std::function<bool(const std::string &)> Setter;
+    const std::vector<std::pair<std::string, Setter>> numbers = {
+        {"numberOfObjects",     [&](const std::string &v) { return parseSize(v, parameters.numberOfObjects); }},
+        {"averageSpeedPx",      [&](const std::string &v) { return parseFloat(v, parameters.averageSpeedPx); }},
+        {"minBlobArea",         [&](const std::string &v) { return parseSize(v, parameters.minBlobArea); }},
+        {"maxBlobArea",         [&](const std::string &v) { return parseSize(v, parameters.maxBlobArea); }},
+        {"numberOfErosions",    [&](const std::string &v) { return parseSize(v, parameters.numberOfErosions); }},
+        {"numberOfDilations",   [&](const std::string &v) { return parseSize(v, parameters.numberOfDilations); }},
+        {"backgroundWeight",    [&](const std::string &v) { return parseFloat(v, parameters.backgroundWeight); }},
+        {"diffThreshold",       [&](const std::string &v) { return parseThreshold(v, parameters.diffThreshold); }},
+        {"framesTillPromotion", [&](const std::string &v) { return parseSize(v, parameters.framesTillPromotion); }},
+        {"candidateCapacity",   [&](const std::string &v) { return parseSize(v, parameters.candidateCapacity); }},
+        {"retentionWindow",     [&](const std::string &v) { return parseSize(v, parameters.retentionWindow); }},
+        {"spillArchive",        [&](const std::string &v) { return parseFlag(v, parameters.spillArchive); }},
+    };
+    for (const auto &number : numbers) {
+        const cv::FileNode node = root[number.first];
+        if (node.empty()) {
+            continue;
+        }
+        std::string text;
+        if (!numberText(node, text) || !number.second(text)) {
+            std::cerr << "invalid value for " << number.first << " in " << path << "\n";
+            return false;
+        }
+    }
+    const cv::FileNode polarity = root["polarity"];
+    if (!polarity.empty()) {
+        std::string text;
+        polarity >> text;
+        if (!parsePolarity(text, parameters.polarity)) {
+            std::cerr << "invalid value for polarity in " << path << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns false and explains why if the arguments are not usable
+bool parseArguments(int argc, char **argv, Options &options) {
+    TrackerParameters &parameters = options.parameters;
+    typedef std::function<bool(const std::string &)> Setter;
+    const std::map<std::string, Setter> setters = {
+        {"--config",     [&](const std::string &v) { return readConfig(v, parameters); }},
+        {"--objects",    [&](const std::string &v) { return parseSize(v, parameters.numberOfObjects); }},
+        {"--speed",      [&](const std::string &v) { return parseFloat(v, parameters.averageSpeedPx); }},
+        {"--polarity",   [&](const std::string &v) { return parsePolarity(v, parameters.polarity); }},
+        {"--min-area",   [&](const std::string &v) { return parseSize(v, parameters.minBlobArea); }},
+        {"--max-area",   [&](const std::string &v) { return parseSize(v, parameters.maxBlobArea); }},
+        {"--erosions",   [&](const std::string &v) { return parseSize(v, parameters.numberOfErosions); }},
+        {"--dilations",  [&](const std::string &v) { return parseSize(v, parameters.numberOfDilations); }},
+        {"--alpha",      [&](const std::string &v) { return parseFloat(v, parameters.backgroundWeight); }},
+        {"--threshold",  [&](const std::string &v) { return parseThreshold(v, parameters.diffThreshold); }},
+        {"--promotion",  [&](const std::string &v) { return parseSize(v, parameters.framesTillPromotion); }},
+        {"--candidates", [&](const std::string &v) { return parseSize(v, parameters.candidateCapacity); }},
+        {"--retention",  [&](const std::string &v) { return parseSize(v, parameters.retentionWindow); }},
+        {"--spill",      [&](const std::string &v) { return parseFlag(v, parameters.spillArchive); }},
+        {"--first",      [&](const std::string &v) { return parseSize(v, options.first); }},
+        {"--end",        [&](const std::string &v) { return parseSize(v, options.end); }},
+        {"--chunks",     [&](const std::string &v) { return parseSize(v, options.chunks); }},
+        {"--overlap",    [&](const std::string &v) { return parseSize(v, options.overlap); }},
+    };
+
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        if (argument.size() < 2 || argument.compare(0, 2, "--") != 0) {
+            positional.push_back(argument);
+            continue;
+        }
+        const auto setter = setters.find(argument);
+        if (setter == setters.end()) {
+            std::cerr << "unknown option " << argument << "\n";
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << argument << " needs a value\n";
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (!setter->second(value)) {
+            std::cerr << "invalid value for " << argument << ": " << value << "\n";
+            return false;
+        }
+    }
+    // no GUI to look at the coarse or predicted segmentation, full frames only
+    parameters.pipelinedMapping = false;
+    parameters.predictiveRoi = false;
+    parameters.pyramidFactor = 1;
+
+    if (positional.size() != 2) {
+        std::cerr << "expected an input and an output\n";
+        return false;
+    }
+    options.input = positional[0];
+    options.output = positional[1];
+    return true;
+}
+
+bool endsWith(const std::string &text, const std::string &suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--help") {
+            printUsage(std::cout);
+            return 0;
+        }
+    }
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage(std::cerr);
+        return 2;
+    }
+
+    const auto started = std::chrono::steady_clock::now();
+    OfflineTracker tracker(options.parameters);
+    tracker.setChunkCount(options.chunks);
+    tracker.setOverlap(options.overlap);
+    std::vector<TrackedObject> tracks;
+    if (!tracker.run(options.input, tracks, options.first, options.end)) {
+        std::cerr << "cannot read " << options.input << "\n";
+        return 1;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    const QString output = QString::fromStdString(options.output);
+    const bool written = endsWith(options.output, ".json") ? TrajectoryFile::writeJson(output, tracks)
+                                                           : TrajectoryFile::write(output, tracks);
+    if (!written) {
+        std::cerr << "cannot write " << options.output << "\n";
+        return 1;
+    }
+    std::cout << tracks.size() << " tracks written to " << options.output << " in " << seconds << " s\n";
+    return 0;
+}
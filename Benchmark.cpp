@@ -0,0 +1,1327 @@
+// Benchmarks and regression checks for the tracking pipeline, run on
+// synthetic frames so they need no video.
+//
+//   simpleTracker.bench [--quick] [name...]
+//
+// Without names every benchmark runs. Each one prints its timings and fails
+// if one of its checks does not hold (results that have to stay bit-exact,
+// error bounds); the exit code is then 1. --quick runs small sizes and few
+// repetitions only, which is what ctest does.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <QFile>
+#include <QString>
+#include <QTemporaryDir>
+
+#include <opencv2/opencv.hpp>
+
+#include "Association.h"
+#include "FishPose.h"
+#include "ForegroundExtractor.h"
+#include "IdentityCost.h"
+#include "Mapper.h"
+#include "Morphology.h"
+#include "OfflineTracker.h"
+#include "PoseJournal.h"
+#include "PosePool.h"
+#include "SegmentationEngine.h"
+#include "SpatialGrid.h"
+#include "TrackStatistics.h"
+#include "TrackedFish.h"
+#include "TrackerParameters.h"
+#include "TrajectoryFile.h"
+
+namespace {
+
+// every heap request of the process, see operator new below
+std::atomic<size_t> heapRequests(0);
+
+struct Options {
+    bool quick;
+};
+
+// milliseconds per call of run, the best of repetitions
+template <class Run>
+double milliseconds(size_t repetitions, Run run) {
+    double best = 0.0;
+    for (size_t i = 0; i < repetitions; i++) {
+        const auto started = std::chrono::steady_clock::now();
+        run();
+        const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        best = i == 0 ? elapsed : std::min(best, elapsed);
+    }
+    return best;
+}
+
+bool identical(const cv::Mat &a, const cv::Mat &b) {
+    if (a.size() != b.size() || a.type() != b.type()) {
+        return false;
+    }
+    for (int y = 0; y < a.rows; y++) {
+        if (std::memcmp(a.ptr(y), b.ptr(y), a.cols * a.elemSize()) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool identical(const std::vector<cv::RotatedRect> &a, const std::vector<cv::RotatedRect> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].center != b[i].center || a[i].size != b[i].size || a[i].angle != b[i].angle) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// bitwise, so NaNs compare equal to themselves
+bool identical(float a, float b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+bool check(bool condition, const char *what) {
+    if (!condition) {
+        std::printf("  FAILED: %s\n", what);
+    }
+    return condition;
+}
+
+// A textured background and a frame with dark, bright or mixed elliptic
+// fish on top of it, all from a fixed seed.
+struct Scene {
+    cv::Mat                         background;
+    cv::Mat                         frame;
+    std::vector<cv::RotatedRect>    fish;
+
+    Scene(cv::Size size, size_t fishCount, int contrast, uint64 seed = 1) {
+        cv::RNG rng(seed);
+        background.create(size, CV_8UC1);
+        for (int y = 0; y < size.height; y++) {
+            uchar *row = background.ptr<uchar>(y);
+            for (int x = 0; x < size.width; x++) {
+                row[x] = cv::saturate_cast<uchar>(96 + 64 * x / size.width + 32 * y / size.height + rng.uniform(-6, 7));
+            }
+        }
+        frame = background.clone();
+        // sensor noise on top of the background
+        for (int y = 0; y < size.height; y++) {
+            uchar *row = frame.ptr<uchar>(y);
+            for (int x = 0; x < size.width; x++) {
+                row[x] = cv::saturate_cast<uchar>(row[x] + rng.uniform(-4, 5));
+            }
+        }
+        for (size_t i = 0; i < fishCount; i++) {
+            const cv::Point2f center(static_cast<float>(rng.uniform(40, size.width - 40)),
+                                     static_cast<float>(rng.uniform(40, size.height - 40)));
+            const cv::RotatedRect ellipse(center, cv::Size2f(static_cast<float>(rng.uniform(5, 10)),
+                                                             static_cast<float>(rng.uniform(16, 32))),
+                                          static_cast<float>(rng.uniform(0, 180)));
+            draw(ellipse, contrast == 0 ? (i % 2 == 0 ? -60 : 60) : contrast);
+            fish.push_back(ellipse);
+        }
+    }
+
+    // adds offset to every frame pixel inside the ellipse
+    void draw(const cv::RotatedRect &ellipse, int offset) {
+        const float radians = ellipse.angle * static_cast<float>(CV_PI / 180.0);
+        const float c = std::cos(radians);
+        const float s = std::sin(radians);
+        const float a = ellipse.size.width / 2;
+        const float b = ellipse.size.height / 2;
+        const int reach = static_cast<int>(std::ceil(std::max(a, b)));
+        for (int y = std::max(0, cvFloor(ellipse.center.y) - reach); y <= std::min(frame.rows - 1, cvCeil(ellipse.center.y) + reach); y++) {
+            uchar *row = frame.ptr<uchar>(y);
+            for (int x = std::max(0, cvFloor(ellipse.center.x) - reach); x <= std::min(frame.cols - 1, cvCeil(ellipse.center.x) + reach); x++) {
+                const float dx = x - ellipse.center.x;
+                const float dy = y - ellipse.center.y;
+                const float u = (dx * c + dy * s) / a;
+                const float v = (-dx * s + dy * c) / b;
+                if (u * u + v * v <= 1.0f) {
+                    row[x] = cv::saturate_cast<uchar>(row[x] + offset);
+                }
+            }
+        }
+    }
+};
+
+std::vector<cv::Size> resolutions(const Options &options) {
+    if (options.quick) {
+        return {cv::Size(640, 480)};
+    }
+    return {cv::Size(640, 480), cv::Size(1920, 1080), cv::Size(2048, 2048), cv::Size(3840, 2160)};
+}
+
+// segmentation parameters that fit the fish of a Scene
+TrackerParameters sceneParameters(size_t fishCount) {
+    TrackerParameters parameters;
+    parameters.numberOfObjects = fishCount;
+    parameters.polarity = ForegroundExtractor::Both;
+    parameters.diffThreshold = 20;
+    parameters.numberOfErosions = 1;
+    parameters.numberOfDilations = 1;
+    parameters.minBlobArea = 20;
+    parameters.maxBlobArea = 1000;
+    return parameters;
+}
+
+const char *polarityName(ForegroundExtractor::Polarity polarity) {
+    switch (polarity) {
+    case ForegroundExtractor::Darker:   return "darker";
+    case ForegroundExtractor::Brighter: return "brighter";
+    case ForegroundExtractor::Both:     return "both";
+    }
+    return "";
+}
+
+// ============== P O L A R I T Y ================
+
+// the difference and threshold of the original track(): cv::subtract or
+// cv::absdiff, then a column-major loop that parses the threshold label for
+// every pixel
+void legacyForeground(const cv::Mat &background, const cv::Mat &frameGRAY, cv::Mat &foreground,
+                      ForegroundExtractor::Polarity polarity, const QString &thresholdText) {
+    if (polarity == ForegroundExtractor::Darker) {
+        cv::subtract(background, frameGRAY, foreground);
+    } else if (polarity == ForegroundExtractor::Brighter) {
+        cv::subtract(frameGRAY, background, foreground);
+    } else {
+        cv::absdiff(frameGRAY, background, foreground);
+    }
+    for (int i = 0; i < foreground.cols; i++) {
+        for (int j = 0; j < foreground.rows; j++) {
+            if (foreground.at<uchar>(cv::Point(i, j)) < thresholdText.toUInt()) {
+                foreground.at<uchar>(cv::Point(i, j)) = 0;
+            }
+        }
+    }
+}
+
+bool benchPolarity(const Options &options) {
+    bool passed = true;
+    const size_t repetitions = options.quick ? 1 : 10;
+    const uchar threshold = 15;
+    const QString thresholdText = QString::number(threshold);
+    std::printf("%-12s %-9s %12s %12s %8s\n", "size", "polarity", "legacy ms", "fused ms", "speedup");
+    for (const cv::Size &size : resolutions(options)) {
+        const Scene scene(size, 50, 0);
+        for (ForegroundExtractor::Polarity polarity : {ForegroundExtractor::Darker, ForegroundExtractor::Brighter,
+                                                       ForegroundExtractor::Both}) {
+            cv::Mat legacy;
+            cv::Mat fused;
+            const double legacyTime = milliseconds(repetitions, [&] {
+                legacyForeground(scene.background, scene.frame, legacy, polarity, thresholdText);
+            });
+            const double fusedTime = milliseconds(repetitions, [&] {
+                ForegroundExtractor::extract(scene.background, scene.frame, fused, polarity, threshold);
+            });
+            std::printf("%5dx%-6d %-9s %12.3f %12.3f %7.1fx\n", size.width, size.height, polarityName(polarity),
+                        legacyTime, fusedTime, legacyTime / fusedTime);
+            passed &= check(identical(legacy, fused), "fused foreground differs from subtract/absdiff + threshold loop");
+        }
+    }
+    return passed;
+}
+
+// =============== T H R E A D S =================
+
+bool benchThreads(const Options &options) {
+    bool passed = true;
+    const size_t repetitions = options.quick ? 1 : 10;
+    const size_t cpus = SegmentationEngine::resolveThreadCount(0);
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < cpus; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(cpus);
+
+    std::printf("%-12s %8s %8s %12s %8s\n", "size", "threads", "blobs", "ms", "speedup");
+    for (const cv::Size &size : resolutions(options)) {
+        const Scene scene(size, 50, 0);
+        const TrackerParameters parameters = sceneParameters(scene.fish.size());
+        SegmentationEngine engine;
+        cv::Mat foreground;
+        std::vector<cv::RotatedRect> reference;
+        double single = 0.0;
+        for (size_t threads : threadCounts) {
+            engine.setThreadCount(threads);
+            std::vector<cv::RotatedRect> ellipses;
+            const double time = milliseconds(repetitions, [&] {
+                engine.segment(scene.background, scene.frame, parameters, foreground, ellipses);
+            });
+            if (threads == 1) {
+                single = time;
+                reference = ellipses;
+            }
+            std::printf("%5dx%-6d %8zu %8zu %12.3f %7.1fx\n", size.width, size.height, threads, ellipses.size(),
+                        time, single / time);
+            passed &= check(identical(ellipses, reference), "blobs depend on the number of strips");
+        }
+    }
+    return passed;
+}
+
+// ============ M O R P H O L O G Y ==============
+
+// the morphology of the original track(): one 3x3 cv::erode or cv::dilate
+// call per iteration
+void legacyMorphology(cv::Mat &image, size_t erosions, size_t dilations) {
+    for (size_t i = 0; i < erosions; i++) {
+        cv::erode(image, image, cv::Mat());
+    }
+    for (size_t i = 0; i < dilations; i++) {
+        cv::dilate(image, image, cv::Mat());
+    }
+}
+
+bool benchMorphology(const Options &options) {
+    bool passed = true;
+    const size_t repetitions = options.quick ? 1 : 5;
+    const cv::Size size = options.quick ? cv::Size(640, 480) : cv::Size(1920, 1080);
+    // on the gray frame rather than a thresholded foreground, which would be
+    // all zero after a few erosions and compare equal trivially
+    const Scene scene(size, 50, 0);
+
+    std::printf("%-12s %10s %12s %12s %8s\n", "size", "iterations", "legacy ms", "passes ms", "speedup");
+    Morphology morphology;
+    for (size_t k = 0; k <= 25; k++) {
+        if (options.quick && k > 3 && k % 5 != 0) {
+            continue;
+        }
+        cv::Mat legacy;
+        cv::Mat passes;
+        const double legacyTime = milliseconds(repetitions, [&] {
+            scene.frame.copyTo(legacy);
+            legacyMorphology(legacy, k, k);
+        });
+        const double passesTime = milliseconds(repetitions, [&] {
+            scene.frame.copyTo(passes);
+            morphology.apply(passes, k, k);
+        });
+        std::printf("%5dx%-6d %10zu %12.3f %12.3f %7.1fx\n", size.width, size.height, k, legacyTime, passesTime,
+                    legacyTime / passesTime);
+        passed &= check(identical(legacy, passes), "Morphology::apply differs from iterated cv::erode/cv::dilate");
+    }
+    return passed;
+}
+
+// =============== P Y R A M I D =================
+
+bool benchPyramid(const Options &options) {
+    bool passed = true;
+    const size_t repetitions = options.quick ? 1 : 5;
+    std::printf("%-12s %6s %8s %8s %8s %9s %9s %12s %12s %8s\n", "size", "factor", "blobs", "found", "exact",
+                "complete", "fallback", "full ms", "coarse ms", "speedup");
+    for (const cv::Size &size : resolutions(options)) {
+        const Scene scene(size, 50, 0);
+        TrackerParameters parameters = sceneParameters(scene.fish.size());
+        SegmentationEngine engine;
+        cv::Mat foreground;
+        std::vector<cv::RotatedRect> full;
+        const double fullTime = milliseconds(repetitions, [&] {
+            engine.segment(scene.background, scene.frame, parameters, foreground, full);
+        });
+
+        for (size_t factor = 2; factor <= 4; factor++) {
+            parameters.pyramidFactor = factor;
+            const cv::Size coarse = SegmentationEngine::coarseSize(size, factor);
+            cv::Mat coarseBackground;
+            cv::Mat coarseGRAY;
+            cv::resize(scene.background, coarseBackground, coarse, 0, 0, cv::INTER_AREA);
+            std::vector<cv::RotatedRect> refined;
+            bool complete = false;
+            const double coarseTime = milliseconds(repetitions, [&] {
+                cv::resize(scene.frame, coarseGRAY, coarse, 0, 0, cv::INTER_AREA);
+                complete = engine.segmentCoarseToFine(coarseBackground, coarseGRAY, scene.background, scene.frame,
+                                                      parameters, foreground, refined);
+            });
+
+            // a blob refined inside a window that contains all of it has the
+            // same moments as in the full frame, so matches are exact
+            size_t found = 0;
+            size_t exact = 0;
+            for (const cv::RotatedRect &ellipse : refined) {
+                for (const cv::RotatedRect &reference : full) {
+                    if (ellipse.center == reference.center) {
+                        found++;
+                        exact += ellipse.size == reference.size && ellipse.angle == reference.angle ? 1 : 0;
+                        break;
+                    }
+                }
+            }
+            // SimpleTracker segments the full frame again in that case
+            const bool fallback = !complete || refined.size() < parameters.numberOfObjects;
+            std::printf("%5dx%-6d %6zu %8zu %8zu %8zu %9s %9s %12.3f %12.3f %7.1fx\n", size.width, size.height, factor,
+                        full.size(), found, exact, complete ? "yes" : "no", fallback ? "yes" : "no",
+                        fullTime, coarseTime, fullTime / coarseTime);
+            if (complete) {
+                passed &= check(found == refined.size() && exact == found,
+                                "a blob refined in a complete window differs from the full frame");
+            }
+        }
+    }
+    return passed;
+}
+
+// ============ A S S O C I A T I O N ============
+
+// Fish swimming in an arena with a fixed density. Every step gives one
+// association problem: the poses of the previous frame against the shuffled
+// ellipses of the current one, with the right answer known.
+struct Swarm {
+    // in fish order
+    std::vector<cv::RotatedRect>    previous;
+    std::vector<float>              previousAngles;
+    std::vector<cv::RotatedRect>    detections;
+    // detection index of every fish
+    std::vector<int>                truth;
+
+    Swarm(size_t fishCount, float speed)
+        : _rng(7)
+        , _speed(speed)
+        , _arena(std::sqrt(static_cast<float>(fishCount)) * 160.0f)
+    {
+        for (size_t i = 0; i < fishCount; i++) {
+            _positions.push_back(cv::Point2f(_rng.uniform(0.0f, _arena), _rng.uniform(0.0f, _arena)));
+            _headings.push_back(_rng.uniform(0.0f, static_cast<float>(2 * CV_PI)));
+        }
+    }
+
+    void step() {
+        previous = ellipses();
+        previousAngles = _headings;
+        for (size_t i = 0; i < _positions.size(); i++) {
+            _headings[i] += _rng.uniform(-0.4f, 0.4f);
+            const float distance = _speed * _rng.uniform(0.3f, 1.5f);
+            cv::Point2f &position = _positions[i];
+            position.x = std::min(std::max(position.x + distance * std::cos(_headings[i]), 0.0f), _arena);
+            position.y = std::min(std::max(position.y + distance * std::sin(_headings[i]), 0.0f), _arena);
+        }
+        const std::vector<cv::RotatedRect> current = ellipses();
+        std::vector<int> order(current.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = static_cast<int>(i);
+        }
+        for (size_t i = order.size(); i > 1; i--) {
+            std::swap(order[i - 1], order[static_cast<size_t>(_rng.uniform(0, static_cast<int>(i)))]);
+        }
+        detections.resize(current.size());
+        truth.resize(current.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            detections[i] = current[static_cast<size_t>(order[i])];
+            truth[static_cast<size_t>(order[i])] = static_cast<int>(i);
+        }
+    }
+
+private:
+    std::vector<cv::RotatedRect> ellipses() const {
+        std::vector<cv::RotatedRect> result;
+        for (size_t i = 0; i < _positions.size(); i++) {
+            float degrees = std::fmod(_headings[i] * static_cast<float>(180.0 / CV_PI), 180.0f);
+            degrees = degrees < 0 ? degrees + 180.0f : degrees;
+            result.push_back(cv::RotatedRect(_positions[i], cv::Size2f(6, 20), degrees));
+        }
+        return result;
+    }
+
+    cv::RNG                     _rng;
+    float                       _speed;
+    float                       _arena;
+    std::vector<cv::Point2f>    _positions;
+    std::vector<float>          _headings;
+};
+
+// the association of the original Mapper: every fish in turn takes the best
+// scoring gated contour left. Its mutual-nearest check never ran, since it was
+// skipped for fish not tested yet, which every fish is on the first call.
+void legacyAssociate(const std::vector<cv::RotatedRect> &previous, const std::vector<float> &angles,
+                     const std::vector<cv::RotatedRect> &detections, std::vector<int> &assignment) {
+    std::vector<FishPose> fishes;
+    for (size_t i = 0; i < previous.size(); i++) {
+        fishes.push_back(FishPose(1, previous[i]));
+        fishes.back().setAngle(angles[i]);
+    }
+    std::vector<cv::RotatedRect> contours(detections);
+    std::vector<int> indices(detections.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        indices[i] = static_cast<int>(i);
+    }
+    assignment.assign(previous.size(), -1);
+    for (size_t f = 0; f < fishes.size() && !contours.empty(); f++) {
+        FishPose &fish = fishes[f];
+        int best = -1;
+        float bestProbability = -1.0f;
+        for (size_t i = 0; i < contours.size(); i++) {
+            float distance = -1.0f;
+            const float probability = fish.calculateProbabilityOfIdentity(contours[i], distance);
+            if (distance > 3 * FishPose::_averageSpeed * fish.age_of_last_known_position()) {
+                continue;
+            }
+            if (probability > bestProbability) {
+                best = static_cast<int>(i);
+                bestProbability = probability;
+            }
+        }
+        if (best >= 0) {
+            assignment[f] = indices[static_cast<size_t>(best)];
+            contours.erase(contours.begin() + best);
+            indices.erase(indices.begin() + best);
+        }
+    }
+}
+
+// gated edges as Mapper::associate builds them
+void gatedEdges(const std::vector<cv::RotatedRect> &previous, const std::vector<float> &angles,
+                const std::vector<cv::RotatedRect> &detections, std::vector<AssociationEdge> &edges) {
+    const float gate = 3 * FishPose::_averageSpeed;
+    const IdentityCost identityCost(FishPose::_averageSpeedSigma);
+    SpatialGrid grid;
+    grid.build(detections, gate);
+    ContourBatch contours;
+    contours.assign(detections);
+    ContourBatch nearbyContours;
+    std::vector<size_t> nearby;
+    std::vector<float> probabilities;
+    std::vector<float> distances;
+    edges.clear();
+    for (size_t i = 0; i < previous.size(); i++) {
+        grid.query(previous[i].center, gate, nearby);
+        nearbyContours.gather(contours, nearby);
+        probabilities.resize(nearby.size());
+        distances.resize(nearby.size());
+        identityCost.evaluate(previous[i].center, angles[i], nearbyContours, probabilities.data(), distances.data());
+        for (size_t k = 0; k < nearby.size(); k++) {
+            if (distances[k] <= gate && std::isfinite(probabilities[k])) {
+                edges.push_back({i, nearby[k], 1.0 - probabilities[k]});
+            }
+        }
+    }
+}
+
+double assignmentCost(const std::vector<AssociationEdge> &edges, const std::vector<int> &assignment,
+                      double unmatchedCost) {
+    double cost = 0.0;
+    for (size_t row = 0; row < assignment.size(); row++) {
+        cost += assignment[row] < 0 ? unmatchedCost : 0.0;
+    }
+    for (const AssociationEdge &edge : edges) {
+        cost += assignment[edge.row] == static_cast<int>(edge.column) ? edge.cost : 0.0;
+    }
+    return cost;
+}
+
+size_t correctAssignments(const std::vector<int> &assignment, const std::vector<int> &truth) {
+    size_t correct = 0;
+    for (size_t i = 0; i < assignment.size(); i++) {
+        correct += assignment[i] == truth[i] ? 1 : 0;
+    }
+    return correct;
+}
+
+bool benchAssociation(const Options &options) {
+    bool passed = true;
+    const size_t frames = options.quick ? 20 : 200;
+    const float speed = 8.0f;
+    const float previousSpeed = FishPose::_averageSpeed;
+    const float previousSigma = FishPose::_averageSpeedSigma;
+    FishPose::_averageSpeed = speed;
+    FishPose::_averageSpeedSigma = std::sqrt(-(speed * speed / 2) * (1 / std::log(0.33f)));
+    const double unmatchedCost = 2.0;
+
+    std::printf("%-6s %-10s %12s %10s\n", "fish", "solver", "ms/frame", "correct");
+    for (size_t fishCount : {6, 50, 500}) {
+        const char *names[] = {"legacy", "greedy", "hungarian"};
+        double times[3] = {0.0, 0.0, 0.0};
+        size_t correct[3] = {0, 0, 0};
+        bool optimal = true;
+        GreedySolver greedy;
+        HungarianSolver hungarian;
+        std::vector<AssociationEdge> edges;
+        std::vector<int> assignments[3];
+        Swarm swarm(fishCount, speed);
+        for (size_t frame = 0; frame < frames; frame++) {
+            swarm.step();
+            times[0] += milliseconds(1, [&] {
+                legacyAssociate(swarm.previous, swarm.previousAngles, swarm.detections, assignments[0]);
+            });
+            times[1] += milliseconds(1, [&] {
+                gatedEdges(swarm.previous, swarm.previousAngles, swarm.detections, edges);
+                greedy.solve(fishCount, swarm.detections.size(), edges, unmatchedCost, assignments[1]);
+            });
+            times[2] += milliseconds(1, [&] {
+                gatedEdges(swarm.previous, swarm.previousAngles, swarm.detections, edges);
+                hungarian.solve(fishCount, swarm.detections.size(), edges, unmatchedCost, assignments[2]);
+            });
+            for (size_t s = 0; s < 3; s++) {
+                correct[s] += correctAssignments(assignments[s], swarm.truth);
+            }
+            // every assignment only uses gated edges, so the optimal one can
+            // not cost more than any of them
+            const double cost = assignmentCost(edges, assignments[2], unmatchedCost);
+            optimal &= cost <= assignmentCost(edges, assignments[0], unmatchedCost) + 1e-9
+                    && cost <= assignmentCost(edges, assignments[1], unmatchedCost) + 1e-9;
+        }
+        for (size_t s = 0; s < 3; s++) {
+            std::printf("%-6zu %-10s %12.4f %9.2f%%\n", fishCount, names[s], times[s] / frames,
+                        100.0 * correct[s] / (fishCount * frames));
+        }
+        passed &= check(optimal, "the Hungarian assignment costs more than a greedy one");
+    }
+
+    FishPose::_averageSpeed = previousSpeed;
+    FishPose::_averageSpeedSigma = previousSigma;
+    return passed;
+}
+
+// =============== I D E N T I T Y ===============
+
+// largest relative error of IdentityCost::fastExp against exp over every
+// stride-th float in [-87, 0]
+double fastExpError(uint32_t stride) {
+    const float lowerLimit = -87.0f;
+    uint32_t last;
+    std::memcpy(&last, &lowerLimit, sizeof(last));
+    double worst = 0.0;
+    // negative floats grow in magnitude with their bit pattern, from -0 on
+    for (uint32_t bits = 0x80000000u; ; bits = std::min(bits + stride, last)) {
+        float x;
+        std::memcpy(&x, &bits, sizeof(x));
+        const double exact = std::exp(static_cast<double>(x));
+        worst = std::max(worst, std::abs(IdentityCost::fastExp(x) - exact) / exact);
+        if (bits == last) {
+            break;
+        }
+    }
+    return worst;
+}
+
+bool benchIdentity(const Options &options) {
+    bool passed = true;
+
+    const double error = fastExpError(options.quick ? 64 : 1);
+    std::printf("fastExp relative error on [-87, 0]: %.3g%s\n", error, options.quick ? " (every 64th float)" : "");
+    passed &= check(error < 3e-7, "fastExp is off by more than 3e-7 relative");
+    bool zero = true;
+    for (float x : {std::nextafter(-87.0f, -88.0f), -88.0f, -1000.0f, -std::numeric_limits<float>::infinity(),
+                    std::numeric_limits<float>::quiet_NaN()}) {
+        zero &= IdentityCost::fastExp(x) == 0.0f;
+    }
+    passed &= check(zero, "fastExp is not 0 below -87");
+
+    const float speed = 8.0f;
+    const float distanceSigma = std::sqrt(-(speed * speed / 2) * (1 / std::log(0.33f)));
+    const float previousSigma = FishPose::_averageSpeedSigma;
+    FishPose::_averageSpeedSigma = distanceSigma;
+
+    // a pose against contours around it, with angles all around
+    cv::RNG rng(3);
+    std::vector<cv::RotatedRect> contours;
+    for (size_t i = 0; i < 1021; i++) {
+        contours.push_back(cv::RotatedRect(cv::Point2f(rng.uniform(0.0f, 60.0f), rng.uniform(0.0f, 60.0f)),
+                                           cv::Size2f(6, 20), rng.uniform(0.0f, 180.0f)));
+    }
+    FishPose pose(1, cv::RotatedRect(cv::Point2f(30, 30), cv::Size2f(6, 20), 0));
+    ContourBatch batch;
+    batch.assign(contours);
+    const IdentityCost identityCost(distanceSigma);
+    std::vector<float> probabilities(contours.size());
+    std::vector<float> distances(contours.size());
+    std::vector<float> legacyProbabilities(contours.size());
+    std::vector<float> legacyDistances(contours.size());
+
+    const size_t repetitions = options.quick ? 20 : 2000;
+    std::printf("%-10s %12s %12s %8s\n", "angle", "legacy ns", "batch ns", "speedup");
+    double probabilityError = 0.0;
+    double distanceError = 0.0;
+    for (float angle : {0.0f, 1.0f, 2.5f, -3.0f}) {
+        pose.setAngle(angle);
+        const double legacyTime = milliseconds(repetitions, [&] {
+            for (size_t i = 0; i < contours.size(); i++) {
+                legacyProbabilities[i] = pose.calculateProbabilityOfIdentity(contours[i], legacyDistances[i]);
+            }
+        });
+        const double batchTime = milliseconds(repetitions, [&] {
+            identityCost.evaluate(pose.last_known_position().center, angle, batch, probabilities.data(), distances.data());
+        });
+        for (size_t i = 0; i < contours.size(); i++) {
+            probabilityError = std::max(probabilityError, static_cast<double>(std::abs(probabilities[i] - legacyProbabilities[i])));
+            distanceError = std::max(distanceError, static_cast<double>(std::abs(distances[i] - legacyDistances[i])));
+        }
+        std::printf("%-10.2f %12.2f %12.2f %7.1fx\n", angle, 1e6 * legacyTime / contours.size(),
+                    1e6 * batchTime / contours.size(), legacyTime / batchTime);
+    }
+    std::printf("largest difference to calculateProbabilityOfIdentity: probability %.3g, distance %.3g\n",
+                probabilityError, distanceError);
+    passed &= check(probabilityError < 1e-6 && distanceError < 1e-4,
+                    "IdentityCost::evaluate differs from calculateProbabilityOfIdentity");
+
+    FishPose::_averageSpeedSigma = previousSigma;
+    return passed;
+}
+
+// ============ A L L O C A T I O N S ============
+
+bool benchAllocations(const Options &options) {
+    bool passed = true;
+    const size_t poses = options.quick ? 20000 : 1000000;
+
+    // every pose on its own heap block as in the original Mapper, against the pool
+    std::printf("%-12s %10s %14s %12s\n", "poses", "allocator", "heap requests", "ms");
+    std::vector<std::shared_ptr<FishPose>> kept;
+    kept.reserve(poses);
+    for (size_t round = 0; round < 2; round++) {
+        size_t requests = heapRequests.load();
+        const double sharedTime = milliseconds(1, [&] {
+            for (size_t i = 0; i < poses; i++) {
+                kept.push_back(std::make_shared<FishPose>());
+            }
+            kept.clear();
+        });
+        std::printf("%-12zu %10s %14zu %12.3f\n", poses, "heap", heapRequests.load() - requests, sharedTime);
+
+        requests = heapRequests.load();
+        const PosePool::Counters before = PosePool::instance().counters();
+        const double pooledTime = milliseconds(1, [&] {
+            for (size_t i = 0; i < poses; i++) {
+                kept.push_back(allocatePose<FishPose>());
+            }
+            kept.clear();
+        });
+        const PosePool::Counters after = PosePool::instance().counters();
+        std::printf("%-12zu %10s %14zu %12.3f\n", poses, "pool", heapRequests.load() - requests, pooledTime);
+        passed &= check(after.live == before.live, "released poses are still counted as live");
+        if (round == 1) {
+            // the first round grew the pool to the number of poses alive at once
+            passed &= check(after.heapAllocations == before.heapAllocations, "the pool went to the heap again");
+        }
+    }
+
+    // pose and heap allocations per frame of a running mapper, once its
+    // history is trimmed to the retention window
+    const size_t frames = options.quick ? 600 : 5000;
+    const size_t window = 128;
+    const float speed = 8.0f;
+    FishPose::_averageSpeed = speed;
+    FishPose::_averageSpeedSigma = std::sqrt(-(speed * speed / 2) * (1 / std::log(0.33f)));
+    // with breaks every track is lost now and then and the fish come back as
+    // new tracks, the ended ones must not keep their poses in memory
+    const size_t breakInterval = 100;
+    std::printf("\n%-6s %7s %14s %14s %14s %12s\n", "fish", "breaks", "poses/frame", "pool heap/fr", "all heap/fr",
+                "live poses");
+    for (bool breaks : {false, true})
+    for (size_t fishCount : {6, 50, 500}) {
+        const size_t liveBefore = PosePool::instance().counters().live;
+        std::vector<BioTracker::Core::TrackedObject> tracks;
+        Mapper mapper(tracks, fishCount, 3);
+        mapper.setRetentionWindow(window);
+        Swarm swarm(fishCount, speed);
+        size_t poseAllocations = 0;
+        size_t poolHeap = 0;
+        size_t requests = 0;
+        size_t measured = 0;
+        size_t live = 0;
+        std::vector<cv::RotatedRect> detections;
+        for (size_t frame = 0; frame < frames; frame++) {
+            swarm.step();
+            detections = swarm.detections;
+            if (breaks && frame % breakInterval == breakInterval / 2) {
+                detections.clear();
+            }
+            const size_t requestsBefore = heapRequests.load();
+            mapper.map(detections, frame);
+            // skip the warm up, until the first trims are through
+            if (frame >= 4 * window) {
+                poseAllocations += mapper.allocationsLastFrame().allocations;
+                poolHeap += mapper.allocationsLastFrame().heapAllocations;
+                requests += heapRequests.load() - requestsBefore;
+                live = std::max(live, mapper.allocationsLastFrame().live - liveBefore);
+                measured++;
+            }
+        }
+        std::printf("%-6zu %7s %14.2f %14.4f %14.2f %12zu\n", fishCount, breaks ? "yes" : "no",
+                    static_cast<double>(poseAllocations) / measured,
+                    static_cast<double>(poolHeap) / measured, static_cast<double>(requests) / measured, live);
+        // up to twice the window per track builds up before a trim
+        passed &= check(live <= (2 * window + 1) * fishCount, "the retention window does not bound the poses in memory");
+    }
+    return passed;
+}
+
+// ============= E S T I M A T O R S =============
+
+bool benchEstimators(const Options &options) {
+    bool passed = true;
+    const size_t frames = options.quick ? 3000 : 100000;
+    const float speed = 8.0f;
+    FishPose::_averageSpeed = speed;
+
+    // a track swimming around with dropouts, fed to the statistics the way
+    // the Mapper feeds a candidate slot
+    cv::RNG rng(11);
+    BioTracker::Core::TrackedObject object(1);
+    TrackedFish &fish = static_cast<TrackedFish &>(object);
+    TrackStatistics statistics;
+    statistics.start(1);
+    cv::Point2f position(500, 500);
+    float heading = 0.0f;
+    size_t mismatches = 0;
+    size_t fastReads = 0;
+    for (size_t frame = 0; frame < frames; frame++) {
+        heading += rng.uniform(-0.3f, 0.3f);
+        position += cv::Point2f(speed * std::cos(heading), -speed * std::sin(heading));
+        if (rng.uniform(0, 10) == 0) {
+            continue;
+        }
+        auto pose = std::make_shared<FishPose>();
+        pose->setNextPosition(cv::RotatedRect(position, cv::Size2f(6, 20), heading * static_cast<float>(180.0 / CV_PI)));
+        pose->setAngle(heading);
+        object.add(frame, pose);
+        statistics.add(1, frame, *pose);
+        // now and then the cache is rebuilt from the track, as after a restore
+        if (rng.uniform(0, 100) == 0) {
+            statistics.load(object, frame);
+        }
+
+        float confidence = 0.0f;
+        float cachedConfidence = 0.0f;
+        const float orientation = fish.estimateOrientationRad(frame, &confidence);
+        const float cachedOrientation = fish.estimateOrientationRad(frame, &cachedConfidence, &statistics);
+        const float currentSpeed = fish.getCurrentSpeed(frame, TrackStatistics::SpeedWindow);
+        const float cachedSpeed = fish.getCurrentSpeed(frame, TrackStatistics::SpeedWindow, &statistics);
+        const FishPose next = fish.getPoseForMapping(frame);
+        const FishPose cachedNext = fish.getPoseForMapping(frame, &statistics);
+        const bool same = identical(orientation, cachedOrientation) && identical(confidence, cachedConfidence)
+                       && identical(currentSpeed, cachedSpeed)
+                       && identical(next.last_known_position().center.x, cachedNext.last_known_position().center.x)
+                       && identical(next.last_known_position().center.y, cachedNext.last_known_position().center.y)
+                       && identical(next.angle(), cachedNext.angle());
+        mismatches += same ? 0 : 1;
+
+        cv::Point2f derivative;
+        float weightSum = 0.0f;
+        fastReads += statistics.orientationSums(1, frame, derivative, weightSum) ? 1 : 0;
+    }
+    std::printf("%zu poses, %zu read their orientation sums from the statistics, %zu mismatches\n",
+                object.count(), fastReads, mismatches);
+    passed &= check(mismatches == 0, "estimates with statistics differ from those computed from the track");
+    passed &= check(fastReads > 0, "the rolling sums were never used");
+
+    // the estimator the Mapper runs per track and frame, at the end of the long track
+    const size_t last = object.maximumFrameNumber();
+    statistics.load(object, last);
+    const size_t repetitions = options.quick ? 1000 : 100000;
+    volatile float sink = 0.0f;
+    const double trackTime = milliseconds(1, [&] {
+        for (size_t i = 0; i < repetitions; i++) {
+            float confidence;
+            sink = sink + fish.estimateOrientationRad(last, &confidence) + fish.getPoseForMapping(last).angle();
+        }
+    });
+    const double cachedTime = milliseconds(1, [&] {
+        for (size_t i = 0; i < repetitions; i++) {
+            float confidence;
+            sink = sink + fish.estimateOrientationRad(last, &confidence, &statistics)
+                        + fish.getPoseForMapping(last, &statistics).angle();
+        }
+    });
+    std::printf("%-22s %10s\n", "orientation + next pose", "ns/call");
+    std::printf("%-22s %10.1f\n", "from the track", 1e6 * trackTime / repetitions);
+    std::printf("%-22s %10.1f\n", "from the statistics", 1e6 * cachedTime / repetitions);
+    return passed;
+}
+
+// ================ J O U R N A L ================
+
+bool samePose(const FishPose &a, const FishPose &b) {
+    for (int c = 0; c < 4; c++) {
+        if (a.associated_color()[c] != b.associated_color()[c]) {
+            return false;
+        }
+    }
+    return identical(a.last_known_position().center.x, b.last_known_position().center.x)
+        && identical(a.last_known_position().center.y, b.last_known_position().center.y)
+        && identical(a.last_known_position().angle, b.last_known_position().angle)
+        && identical(a.angle(), b.angle())
+        && a.age_of_last_known_position() == b.age_of_last_known_position()
+        && !dynamic_cast<const FishCandidate *>(&a) == !dynamic_cast<const FishCandidate *>(&b);
+}
+
+// the same tracks with the same poses, by id; the journal recovers them in
+// promotion order, which is not the mapper's once a rewind dropped some
+bool sameTracks(const std::vector<BioTracker::Core::TrackedObject> &expected,
+                const std::vector<BioTracker::Core::TrackedObject> &recovered, size_t frames) {
+    std::map<size_t, const BioTracker::Core::TrackedObject *> byId;
+    for (const BioTracker::Core::TrackedObject &object : recovered) {
+        if (!byId.emplace(object.getId(), &object).second) {
+            return false;
+        }
+    }
+    if (byId.size() != expected.size()) {
+        return false;
+    }
+    for (const BioTracker::Core::TrackedObject &object : expected) {
+        const auto found = byId.find(object.getId());
+        if (found == byId.end()) {
+            return false;
+        }
+        for (size_t frame = 0; frame < frames; frame++) {
+            if (object.hasValuesAtFrame(frame) != found->second->hasValuesAtFrame(frame)) {
+                return false;
+            }
+            if (object.hasValuesAtFrame(frame)
+                    && !samePose(*object.get<FishPose>(frame), *found->second->get<FishPose>(frame))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool readFile(const QString &path, QByteArray &bytes) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    bytes = file.readAll();
+    return true;
+}
+
+bool writeFile(const QString &path, const QByteArray &bytes) {
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(bytes) == bytes.size();
+}
+
+// Tracks a swarm with breaks, writes the tracks as a TrajectoryFile and reads
+// them back pose by pose and all at once. A file with the byte order of the
+// other endianness in its header must not open.
+bool benchTrajectories(const Options &options) {
+    bool passed = true;
+    const size_t fishCount = 20;
+    const size_t frames = options.quick ? 400 : 10000;
+    const size_t breakInterval = 100;
+    const float speed = 8.0f;
+    FishPose::_averageSpeed = speed;
+    FishPose::_averageSpeedSigma = std::sqrt(-(speed * speed / 2) * (1 / std::log(0.33f)));
+
+    std::vector<BioTracker::Core::TrackedObject> tracks;
+    {
+        Mapper mapper(tracks, fishCount, 3);
+        Swarm swarm(fishCount, speed);
+        std::vector<cv::RotatedRect> detections;
+        for (size_t frame = 0; frame < frames; frame++) {
+            swarm.step();
+            detections = swarm.detections;
+            if (frame % breakInterval == breakInterval / 2) {
+                detections.clear();
+            }
+            mapper.map(detections, frame);
+        }
+    }
+    size_t poses = 0;
+    for (const BioTracker::Core::TrackedObject &object : tracks) {
+        poses += object.count();
+    }
+
+    QTemporaryDir directory;
+    if (!check(directory.isValid(), "no temporary directory")) {
+        return false;
+    }
+    const QString path = directory.path() + "/tracks.trajectories";
+    std::printf("%-12s %8s %8s %10s\n", "", "tracks", "poses", "ms");
+    const double writeTime = milliseconds(1, [&] {
+        passed &= check(TrajectoryFile::write(path, tracks), "the tracks cannot be written");
+    });
+    std::printf("%-12s %8zu %8zu %10.3f\n", "write", tracks.size(), poses, writeTime);
+
+    TrajectoryFile file;
+    if (!check(file.open(path), "the file does not open") || !check(file.trackCount() == tracks.size(), "tracks are missing")) {
+        return false;
+    }
+    size_t mismatches = 0;
+    const double poseTime = milliseconds(1, [&] {
+        for (size_t k = 0; k < tracks.size(); k++) {
+            mismatches += file.trackId(k) == tracks[k].getId() ? 0 : 1;
+            for (size_t frame = 0; frame < frames; frame++) {
+                const std::shared_ptr<FishPose> pose = file.pose(k, frame);
+                if (!pose || !tracks[k].hasValuesAtFrame(frame)) {
+                    mismatches += !pose == !tracks[k].hasValuesAtFrame(frame) ? 0 : 1;
+                } else if (!samePose(*pose, *tracks[k].get<FishPose>(frame))) {
+                    mismatches++;
+                }
+            }
+        }
+    });
+    std::printf("%-12s %8zu %8zu %10.3f\n", "pose()", tracks.size(), poses, poseTime);
+    passed &= check(mismatches == 0, "pose() differs from the tracks written");
+
+    std::vector<BioTracker::Core::TrackedObject> read;
+    const double readTime = milliseconds(1, [&] {
+        passed &= check(file.read(read), "the file cannot be read");
+    });
+    std::printf("%-12s %8zu %8zu %10.3f\n", "read()", read.size(), poses, readTime);
+    passed &= check(sameTracks(tracks, read, frames), "read() differs from the tracks written");
+    file.close();
+
+    // the byte order mark follows magic and version
+    QByteArray bytes;
+    passed &= check(readFile(path, bytes), "the file cannot be copied");
+    std::reverse(bytes.data() + 12, bytes.data() + 16);
+    passed &= check(writeFile(path, bytes), "the file cannot be copied");
+    passed &= check(!file.open(path), "a file of the other byte order opens");
+    return passed;
+}
+
+// Tracks a swarm with breaks into a journal, closes it, goes on from the
+// recovered tracks and rewinds across the checkpoint close() wrote. The files
+// are then put into the state of two crashes and recovered: one before the
+// final checkpoint with the last journal record torn, one between writing
+// that checkpoint and truncating the journal.
+bool benchJournal(const Options &options) {
+    bool passed = true;
+    const size_t fishCount = 20;
+    const size_t frames = options.quick ? 400 : 4000;
+    const size_t rewindTo = frames - 150;
+    const size_t end = frames - 70;
+    const size_t breakInterval = 100;
+    const float speed = 8.0f;
+    FishPose::_averageSpeed = speed;
+    FishPose::_averageSpeedSigma = std::sqrt(-(speed * speed / 2) * (1 / std::log(0.33f)));
+
+    QTemporaryDir directory;
+    if (!check(directory.isValid(), "no temporary directory")) {
+        return false;
+    }
+    const QString base = directory.path() + "/tracks";
+    Swarm swarm(fishCount, speed);
+    std::vector<cv::RotatedRect> detections;
+    auto step = [&](Mapper &mapper, size_t frame) {
+        swarm.step();
+        detections = swarm.detections;
+        if (frame % breakInterval == breakInterval / 2) {
+            detections.clear();
+        }
+        mapper.map(detections, frame);
+    };
+
+    std::printf("%-34s %8s %8s %10s\n", "files", "tracks", "poses", "open ms");
+    auto reopen = [&](const char *what, const std::vector<BioTracker::Core::TrackedObject> &expected,
+                      std::vector<BioTracker::Core::TrackedObject> &recovered, PoseJournal &journal) {
+        const auto started = std::chrono::steady_clock::now();
+        const bool opened = journal.open(base, recovered);
+        const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        size_t poses = 0;
+        for (const BioTracker::Core::TrackedObject &object : recovered) {
+            poses += object.count();
+        }
+        std::printf("%-34s %8zu %8zu %10.3f\n", what, recovered.size(), poses, elapsed);
+        passed &= check(opened, "the journal does not open");
+        passed &= check(sameTracks(expected, recovered, frames), "the recovered tracks differ from the tracked ones");
+    };
+
+    std::vector<BioTracker::Core::TrackedObject> tracks;
+    std::vector<BioTracker::Core::TrackedObject> expected;
+    {
+        PoseJournal journal;
+        journal.setCheckpointInterval(breakInterval);
+        passed &= check(journal.open(base, tracks) && tracks.empty(), "a new journal does not start empty");
+        Mapper mapper(tracks, fishCount, 3);
+        mapper.setRetentionWindow(64);
+        mapper.setJournal(&journal);
+        for (size_t frame = 0; frame < rewindTo + 50; frame++) {
+            step(mapper, frame);
+        }
+        mapper.restoreArchivedPoses();
+        expected = tracks;
+    }
+
+    std::vector<BioTracker::Core::TrackedObject> beforeEnd;
+    QByteArray journalBytes;
+    QByteArray segmentBytes;
+    size_t segments = 0;
+    {
+        PoseJournal journal;
+        journal.setCheckpointInterval(breakInterval);
+        std::vector<BioTracker::Core::TrackedObject> recovered;
+        reopen("closed", expected, recovered, journal);
+        tracks = recovered;
+        Mapper mapper(tracks, fishCount, 3);
+        mapper.setRetentionWindow(64);
+        mapper.setJournal(&journal);
+        mapper.invalidateTrackCaches();
+        // back into what the checkpoint of close() holds
+        mapper.rewind(rewindTo);
+        for (size_t frame = rewindTo; frame < end; frame++) {
+            if (frame + 1 == end) {
+                mapper.restoreArchivedPoses();
+                beforeEnd = tracks;
+            }
+            step(mapper, frame);
+        }
+        mapper.restoreArchivedPoses();
+        expected = tracks;
+        passed &= check(journal.flush(), "the journal failed");
+        passed &= check(readFile(base + ".journal", journalBytes) && !journalBytes.isEmpty(), "nothing was journaled");
+        while (QFile::exists(base + ".checkpoint." + QString::number(segments))) {
+            segments++;
+        }
+    }
+    // close() wrote the journal into one more segment
+    const QString closingSegment = base + ".checkpoint." + QString::number(segments);
+    passed &= check(readFile(closingSegment, segmentBytes), "close() wrote no checkpoint");
+
+    {
+        // crashed before the final checkpoint, in the middle of the last
+        // record (they are 80 bytes)
+        QByteArray torn = journalBytes;
+        torn.chop(20);
+        QFile::remove(closingSegment);
+        passed &= check(writeFile(base + ".journal", torn), "cannot write the journal");
+        PoseJournal journal;
+        std::vector<BioTracker::Core::TrackedObject> recovered;
+        reopen("torn record, no checkpoint", beforeEnd, recovered, journal);
+    }
+    {
+        // crashed after writing the final checkpoint, before the journal was
+        // truncated: the segment and the journal hold the same frames
+        passed &= check(writeFile(closingSegment, segmentBytes) && writeFile(base + ".journal", journalBytes),
+                        "cannot write the files");
+        PoseJournal journal;
+        std::vector<BioTracker::Core::TrackedObject> recovered;
+        reopen("checkpoint and full journal", expected, recovered, journal);
+        journal.close();
+        reopen("closed again", expected, recovered, journal);
+    }
+    return passed;
+}
+
+// ============== O F F L I N E ==================
+
+// the pose of a promoted track at frame, nullptr for none or a candidate pose
+std::shared_ptr<FishPose> trackedPose(const BioTracker::Core::TrackedObject &object, size_t frame) {
+    if (!object.hasValuesAtFrame(frame)) {
+        return nullptr;
+    }
+    std::shared_ptr<FishPose> pose = object.get<FishPose>(frame);
+    return std::dynamic_pointer_cast<FishCandidate>(pose) ? nullptr : pose;
+}
+
+// ids that only one side has
+size_t differentIds(const std::vector<BioTracker::Core::TrackedObject> &expected,
+                    const std::vector<BioTracker::Core::TrackedObject> &tracks) {
+    std::vector<size_t> a;
+    std::vector<size_t> b;
+    for (const BioTracker::Core::TrackedObject &object : expected) {
+        a.push_back(object.getId());
+    }
+    for (const BioTracker::Core::TrackedObject &object : tracks) {
+        b.push_back(object.getId());
+    }
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    std::vector<size_t> difference;
+    std::set_symmetric_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(difference));
+    return difference.size();
+}
+
+// poses of tracks with the same id where only one has a pose or both lie
+// further than tolerance apart. Only the poses since a track's promotion
+// count: the candidate poses before it depend on what the mapper saw
+// earlier, which a chunk starts without. Colours differ too, each chunk
+// draws its own.
+size_t differentPoses(const std::vector<BioTracker::Core::TrackedObject> &expected,
+                      const std::vector<BioTracker::Core::TrackedObject> &tracks, size_t frames, float tolerance) {
+    std::map<size_t, const BioTracker::Core::TrackedObject *> byId;
+    for (const BioTracker::Core::TrackedObject &object : tracks) {
+        byId.emplace(object.getId(), &object);
+    }
+    size_t differences = 0;
+    for (const BioTracker::Core::TrackedObject &object : expected) {
+        const auto found = byId.find(object.getId());
+        if (found == byId.end()) {
+            continue;
+        }
+        for (size_t frame = 0; frame < frames; frame++) {
+            const std::shared_ptr<FishPose> a = trackedPose(object, frame);
+            const std::shared_ptr<FishPose> b = trackedPose(*found->second, frame);
+            if (!a || !b) {
+                differences += !a == !b ? 0 : 1;
+            } else {
+                const cv::Point2f offset = a->last_known_position().center - b->last_known_position().center;
+                differences += std::hypot(offset.x, offset.y) <= tolerance ? 0 : 1;
+            }
+        }
+    }
+    return differences;
+}
+
+// Renders a swarm with breaks into an image sequence and tracks it serially
+// and in chunks. Stitched, the chunks have to give the serial ids, with poses
+// at the same frames and positions. A chunk's background starts at another
+// frame and only converges to the serial one up to rounding: a blob may move
+// by a pixel, two touching fish may be split apart differently for a few
+// frames and a candidate may be promoted a frame apart, so a few poses in a
+// thousand may differ.
+bool benchOffline(const Options &options) {
+    bool passed = true;
+    const size_t fishCount = 6;
+    const size_t frames = options.quick ? 1200 : 2400;
+    const size_t breakInterval = 300;
+    const size_t breakLength = 5;
+    // After each seam, so the breaks stay out of the overlaps: a chunk only
+    // knows the serial candidates once it has promoted its own tracks, before
+    // that a track after a break may be promoted a few frames apart.
+    const size_t breakOffset = 25;
+    const float speed = 8.0f;
+
+    QTemporaryDir directory;
+    if (!check(directory.isValid(), "no temporary directory")) {
+        return false;
+    }
+    // lossless and seekable, unlike most codecs
+    const std::string pattern = directory.path().toStdString() + "/frame%05d.png";
+    std::vector<char> name(pattern.size() + 16);
+    Swarm swarm(fishCount, speed);
+    // the arena of the swarm with a margin
+    const int margin = 20;
+    const int side = static_cast<int>(std::sqrt(static_cast<float>(fishCount)) * 160.0f) + 2 * margin;
+    Scene scene(cv::Size(side, side), 0, 0);
+    const cv::Mat still = scene.frame.clone();
+    for (size_t frame = 0; frame < frames; frame++) {
+        swarm.step();
+        still.copyTo(scene.frame);
+        // the fish vanish now and then, long enough to end their tracks
+        const size_t phase = (frame + breakInterval - breakOffset) % breakInterval;
+        if (phase >= breakLength) {
+            for (const cv::RotatedRect &fish : swarm.detections) {
+                scene.draw(cv::RotatedRect(fish.center + cv::Point2f(margin, margin), fish.size, fish.angle), -60);
+            }
+        }
+        std::snprintf(name.data(), name.size(), pattern.c_str(), static_cast<int>(frame));
+        if (!check(cv::imwrite(name.data(), scene.frame), "the video cannot be written")) {
+            return false;
+        }
+    }
+
+    TrackerParameters parameters = sceneParameters(fishCount);
+    parameters.polarity = ForegroundExtractor::Darker;
+    parameters.averageSpeedPx = speed;
+    // fish pushing against a wall of the arena hardly move, a faster
+    // background would take them in
+    parameters.backgroundWeight = 0.99f;
+    OfflineTracker tracker(parameters);
+    std::vector<BioTracker::Core::TrackedObject> serial;
+    std::printf("%-8s %8s %8s %8s %8s %12s\n", "chunks", "tracks", "poses", "ids", "poses", "ms");
+    std::printf("%-8s %8s %8s %8s %8s\n", "", "", "", "differ", "differ");
+    for (size_t chunks : {1, 2, 4}) {
+        std::vector<BioTracker::Core::TrackedObject> tracks;
+        tracker.setChunkCount(chunks);
+        const double time = milliseconds(1, [&] {
+            passed &= check(tracker.run(pattern, tracks), "the video cannot be read");
+        });
+        if (chunks == 1) {
+            serial = tracks;
+        }
+        size_t poses = 0;
+        for (const BioTracker::Core::TrackedObject &object : tracks) {
+            poses += object.count();
+        }
+        const size_t ids = differentIds(serial, tracks);
+        const size_t differences = differentPoses(serial, tracks, frames, speed / 4);
+        std::printf("%-8zu %8zu %8zu %8zu %8zu %12.3f\n", chunks, tracks.size(), poses, ids, differences, time);
+        passed &= check(ids == 0, "the stitched chunks number the tracks differently from the serial run");
+        passed &= check(differences <= poses / 500, "the stitched chunks have other poses than the serial run");
+    }
+    return passed;
+}
+
+// =============== R E G I S T R Y ===============
+
+struct Benchmark {
+    const char  *name;
+    const char  *description;
+    bool       (*run)(const Options &);
+};
+
+const Benchmark Benchmarks[] = {
+    {"polarity", "fused difference and threshold against subtract/absdiff and the per-pixel loop", benchPolarity},
+    {"threads", "strip-parallel segmentation from one thread up to one per cpu", benchThreads},
+    {"morphology", "erosions and dilations in fixed passes against iterated 3x3 calls, 0-25 iterations", benchMorphology},
+    {"pyramid", "coarse-to-fine segmentation at factors 2-4 against the full resolution blobs", benchPyramid},
+    {"association", "greedy and Hungarian assignment over gated edges against the original greedy loop", benchAssociation},
+    {"identity", "batched identity scores against calculateProbabilityOfIdentity, and the fastExp error bound", benchIdentity},
+    {"allocations", "pose allocations through the pool against one heap block each, and per mapped frame", benchAllocations},
+    {"estimators", "TrackedFish estimates from the rolling statistics against those from the track", benchEstimators},
+    {"trajectories", "TrajectoryFile pose() and read() against the tracks written, and the byte order check", benchTrajectories},
+    {"journal", "journal recovery after a rollback across a checkpoint, a torn record and a crash at a checkpoint", benchJournal},
+    {"offline", "chunked offline tracking of a rendered swarm, stitched, against the serial run", benchOffline},
+};
+
+}
+
+// counts the heap requests of the whole process for the allocations benchmark
+void *operator new(size_t size) {
+    heapRequests.fetch_add(1, std::memory_order_relaxed);
+    if (void *block = std::malloc(size == 0 ? 1 : size)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *block) noexcept {
+    std::free(block);
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    options.quick = false;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        if (argument == "--quick") {
+            options.quick = true;
+        } else if (argument == "--help") {
+            std::printf("usage: simpleTracker.bench [--quick] [name...]\n\n");
+            for (const Benchmark &benchmark : Benchmarks) {
+                std::printf("  %-12s %s\n", benchmark.name, benchmark.description);
+            }
+            return 0;
+        } else {
+            names.push_back(argument);
+        }
+    }
+
+    for (const std::string &name : names) {
+        if (std::none_of(std::begin(Benchmarks), std::end(Benchmarks),
+                         [&](const Benchmark &benchmark) { return name == benchmark.name; })) {
+            std::fprintf(stderr, "unknown benchmark %s, see --help\n", name.c_str());
+            return 2;
+        }
+    }
+
+    bool passed = true;
+    for (const Benchmark &benchmark : Benchmarks) {
+        if (!names.empty() && std::find(names.begin(), names.end(), benchmark.name) == names.end()) {
+            continue;
+        }
+        std::printf("== %s: %s\n", benchmark.name, benchmark.description);
+        passed &= benchmark.run(options);
+        std::printf("\n");
+    }
+    return passed ? 0 : 1;
+}
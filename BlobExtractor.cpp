@@ -0,0 +1,102 @@
+#include "BlobExtractor.h"
+
+#include <algorithm>
+#include <limits>
+
+BlobMoments::BlobMoments()
+    : m00(0), m10(0), m01(0), m20(0), m11(0), m02(0)
+    , firstPixel(std::numeric_limits<int64>::max())
+{}
+
+void BlobMoments::merge(const BlobMoments &other) {
+    m00 += other.m00;
+    m10 += other.m10;
+    m01 += other.m01;
+    m20 += other.m20;
+    m11 += other.m11;
+    m02 += other.m02;
+    firstPixel = std::min(firstPixel, other.firstPixel);
+}
+
+cv::RotatedRect BlobMoments::ellipse() const {
+    const double area = static_cast<double>(m00);
+    const double cx = static_cast<double>(m10) / area;
+    const double cy = static_cast<double>(m01) / area;
+
+    // normalized central moments; 1/12 is the variance of a unit pixel, which
+    // keeps one pixel wide blobs from collapsing to a line
+    const double mu20 = (static_cast<double>(m20) - static_cast<double>(m10) * cx) / area + 1.0 / 12.0;
+    const double mu02 = (static_cast<double>(m02) - static_cast<double>(m01) * cy) / area + 1.0 / 12.0;
+    const double mu11 = (static_cast<double>(m11) - static_cast<double>(m10) * cy) / area;
+
+    const double mean = 0.5 * (mu20 + mu02);
+    const double spread = std::sqrt(0.25 * (mu20 - mu02) * (mu20 - mu02) + mu11 * mu11);
+    const double major = std::max(mean + spread, 0.0);
+    const double minor = std::max(mean - spread, 0.0);
+
+    // a solid ellipse with semi axis a has variance a^2 / 4 along that axis
+    const float width = static_cast<float>(4.0 * std::sqrt(minor));
+    const float height = static_cast<float>(4.0 * std::sqrt(major));
+
+    // orientation of the major axis; the width axis is perpendicular to it
+    const double majorAngleDeg = 0.5 * std::atan2(2.0 * mu11, mu20 - mu02) * 180.0 / CV_PI;
+    double angle = std::fmod(majorAngleDeg + 90.0, 180.0);
+    if (angle < 0.0) angle += 180.0;
+
+    return cv::RotatedRect(cv::Point2f(static_cast<float>(cx), static_cast<float>(cy)),
+                           cv::Size2f(width, height), static_cast<float>(angle));
+}
+
+void BlobExtractor::measure(const cv::Mat &foreground, cv::Point origin, int imageWidth,
+                            std::vector<BlobMoments> &blobs)
+{
+    CV_Assert(foreground.type() == CV_8UC1);
+
+    const int count = cv::connectedComponents(foreground, _labels, 8, CV_32S);
+    blobs.assign(static_cast<size_t>(std::max(count - 1, 0)), BlobMoments());
+
+    for (int y = 0; y < _labels.rows; y++) {
+        const int *row = _labels.ptr<int>(y);
+        const int64 gy = origin.y + y;
+        for (int x = 0; x < _labels.cols; x++) {
+            if (row[x] == 0) continue;
+            BlobMoments &blob = blobs[static_cast<size_t>(row[x] - 1)];
+            const int64 gx = origin.x + x;
+            if (blob.m00 == 0) {
+                // labels are assigned in raster order, so the first hit is the first pixel
+                blob.firstPixel = gy * imageWidth + gx;
+            }
+            blob.m00 += 1;
+            blob.m10 += gx;
+            blob.m01 += gy;
+            blob.m20 += gx * gx;
+            blob.m11 += gx * gy;
+            blob.m02 += gy * gy;
+        }
+    }
+}
+
+void BlobExtractor::extract(const cv::Mat &foreground, size_t minArea, size_t maxArea,
+                            std::vector<cv::RotatedRect> &ellipses)
+{
+    measure(foreground, cv::Point(0, 0), foreground.cols, _blobs);
+    toEllipses(_blobs, minArea, maxArea, ellipses);
+}
+
+const cv::Mat &BlobExtractor::labels() const {
+    return _labels;
+}
+
+void BlobExtractor::toEllipses(std::vector<BlobMoments> &blobs, size_t minArea, size_t maxArea,
+                               std::vector<cv::RotatedRect> &ellipses)
+{
+    std::sort(blobs.begin(), blobs.end(), [](const BlobMoments &a, const BlobMoments &b) {
+        return a.firstPixel < b.firstPixel;
+    });
+    ellipses.clear();
+    for (const BlobMoments &blob : blobs) {
+        const size_t area = static_cast<size_t>(blob.m00);
+        if (area == 0 || area < minArea || area > maxArea) continue;
+        ellipses.push_back(blob.ellipse());
+    }
+}
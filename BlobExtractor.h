@@ -0,0 +1,44 @@
+#ifndef BLOB_EXTRACTOR_H
+#define BLOB_EXTRACTOR_H
+
+#include <opencv2/opencv.hpp>
+
+// Raw image moments of one 8-connected blob. They are accumulated in integers,
+// so partial blobs (e.g. from neighbouring tiles) can be summed exactly and in
+// any order.
+struct BlobMoments {
+    BlobMoments();
+
+    void merge(const BlobMoments &other);
+
+    // ellipse with the blob's centroid and second moments, in the same
+    // convention as cv::fitEllipse (width <= height, angle in degrees of the
+    // width axis, 0 <= angle < 180)
+    cv::RotatedRect ellipse() const;
+
+    int64 m00, m10, m01, m20, m11, m02;
+    // raster index of the blob's first pixel; gives a deterministic order
+    int64 firstPixel;
+};
+
+class BlobExtractor {
+public:
+    // moments of every blob in the CV_8UC1 mask (nonzero = foreground).
+    // origin is added to all pixel coordinates, imageWidth is used for firstPixel.
+    void measure(const cv::Mat &foreground, cv::Point origin, int imageWidth, std::vector<BlobMoments> &blobs);
+
+    // ellipses of all blobs with minArea <= area <= maxArea, in raster order
+    void extract(const cv::Mat &foreground, size_t minArea, size_t maxArea, std::vector<cv::RotatedRect> &ellipses);
+
+    static void toEllipses(std::vector<BlobMoments> &blobs, size_t minArea, size_t maxArea,
+                           std::vector<cv::RotatedRect> &ellipses);
+
+    // labels of the last measure() call, 0 = background
+    const cv::Mat &labels() const;
+
+private:
+    cv::Mat                  _labels;
+    std::vector<BlobMoments> _blobs;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "CandidateStore.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+using namespace BioTracker::Core;
+
+const CandidateStore::Handle CandidateStore::Invalid = {std::numeric_limits<uint32_t>::max(), 0};
+
+CandidateStore::CandidateStore(size_t capacity)
+    : _capacity(capacity)
+{}
+
+void CandidateStore::setCapacity(size_t capacity) {
+    _capacity = capacity;
+}
+
+size_t CandidateStore::capacity() const {
+    return _capacity;
+}
+
+size_t CandidateStore::size() const {
+    return _live.size();
+}
+
+bool CandidateStore::empty() const {
+    return _live.empty();
+}
+
+CandidateStore::Handle CandidateStore::spawn(TrackedObject &&candidate, int score) {
+    if (_live.size() >= _capacity) {
+        return Invalid;
+    }
+    size_t slot;
+    if (_free.empty()) {
+        slot = _slots.size();
+        _slots.push_back(std::move(candidate));
+        _generations.push_back(0);
+        _scores.push_back(score);
+        _livePosition.push_back(0);
+    } else {
+        slot = _free.back();
+        _free.pop_back();
+        _slots[slot] = std::move(candidate);
+        _scores[slot] = score;
+    }
+    _livePosition[slot] = _live.size();
+    _live.push_back(slot);
+    return handle(slot);
+}
+
+void CandidateStore::drop(Handle handle) {
+    assert(valid(handle));
+    const size_t slot = handle.slot;
+    // swap with the last live entry instead of shifting
+    const size_t position = _livePosition[slot];
+    _live[position] = _live.back();
+    _livePosition[_live[position]] = position;
+    _live.pop_back();
+
+    // releases the history right away rather than when the slot is reused
+    _slots[slot] = TrackedObject(0);
+    _generations[slot]++;
+    _free.push_back(slot);
+}
+
+void CandidateStore::clear() {
+    while (!_live.empty()) {
+        drop(handle(_live.back()));
+    }
+}
+
+bool CandidateStore::valid(Handle handle) const {
+    return handle.slot < _slots.size() && _generations[handle.slot] == handle.generation
+           && _livePosition[handle.slot] < _live.size() && _live[_livePosition[handle.slot]] == handle.slot;
+}
+
+TrackedObject &CandidateStore::get(Handle handle) {
+    assert(valid(handle));
+    return _slots[handle.slot];
+}
+
+CandidateStore::Handle CandidateStore::handle(size_t slot) const {
+    return Handle{static_cast<uint32_t>(slot), _generations[slot]};
+}
+
+void CandidateStore::setScore(Handle handle, int score) {
+    assert(valid(handle));
+    _scores[handle.slot] = score;
+}
+
+size_t CandidateStore::makeRoom(size_t count, int score) {
+    const size_t available = _capacity > _live.size() ? _capacity - _live.size() : 0;
+    if (available >= count) {
+        return count;
+    }
+
+    // only the lowest scoring candidates are ordered, not the whole store
+    _ranking.clear();
+    for (size_t slot : _live) {
+        if (_scores[slot] <= score) {
+            _ranking.push_back(slot);
+        }
+    }
+    const size_t evictions = std::min(count - available, _ranking.size());
+    std::nth_element(_ranking.begin(), _ranking.begin() + static_cast<std::ptrdiff_t>(evictions), _ranking.end(),
+                     [this](size_t a, size_t b) { return _scores[a] < _scores[b]; });
+    for (size_t i = 0; i < evictions; i++) {
+        drop(handle(_ranking[i]));
+    }
+    return available + evictions;
+}
+
+void CandidateStore::promote(const std::vector<Handle> &handles, std::vector<TrackedObject> &tracks) {
+    tracks.reserve(tracks.size() + handles.size());
+    for (Handle promoted : handles) {
+        tracks.push_back(std::move(get(promoted)));
+        drop(promoted);
+    }
+}
+
+std::vector<TrackedObject> &CandidateStore::slots() {
+    return _slots;
+}
+
+const std::vector<size_t> &CandidateStore::live() const {
+    return _live;
+}
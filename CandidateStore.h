@@ -0,0 +1,73 @@
+#ifndef CANDIDATE_STORE_H
+#define CANDIDATE_STORE_H
+
+#include <cstdint>
+#include <vector>
+
+#include <biotracker/serialization/TrackedObject.h>
+
+// Slot map holding the fish candidates. Slots are reused through a free list
+// and the live ones are kept in a dense index list, so spawning, dropping and
+// promoting a candidate are O(1) and never shift the other candidates. A
+// handle stays valid until its candidate is dropped; the slot's generation
+// changes then, so stale handles are detected instead of aliasing a newer
+// candidate in the same slot.
+class CandidateStore {
+public:
+    struct Handle {
+        uint32_t slot;
+        uint32_t generation;
+
+        bool operator==(const Handle &other) const { return slot == other.slot && generation == other.generation; }
+        bool operator!=(const Handle &other) const { return !(*this == other); }
+    };
+
+    static const Handle Invalid;
+
+    explicit CandidateStore(size_t capacity);
+
+    // never more than capacity candidates are alive; lowering it evicts at the next spawn
+    void setCapacity(size_t capacity);
+    size_t capacity() const;
+
+    size_t size() const;
+    bool empty() const;
+
+    // Invalid if the store is full; call makeRoom() first
+    Handle spawn(BioTracker::Core::TrackedObject &&candidate, int score);
+    void drop(Handle handle);
+    void clear();
+
+    bool valid(Handle handle) const;
+    BioTracker::Core::TrackedObject &get(Handle handle);
+    Handle handle(size_t slot) const;
+
+    // the score eviction ranks a candidate by, kept in sync by the caller
+    void setScore(Handle handle, int score);
+
+    // Evicts the lowest scoring candidates, as long as their score does not
+    // exceed the given one, until count spawns fit. Returns how many fit.
+    size_t makeRoom(size_t count, int score);
+
+    // Moves the candidates to the end of tracks in one go and drops them.
+    void promote(const std::vector<Handle> &handles, std::vector<BioTracker::Core::TrackedObject> &tracks);
+
+    // all slots, for index based access together with live()
+    std::vector<BioTracker::Core::TrackedObject> &slots();
+    // slot indices of the live candidates, in no particular order
+    const std::vector<size_t> &live() const;
+
+private:
+    size_t _capacity;
+
+    std::vector<BioTracker::Core::TrackedObject> _slots;
+    std::vector<uint32_t>                        _generations;
+    std::vector<int>                             _scores;
+    // index into _live per slot
+    std::vector<size_t>                          _livePosition;
+    std::vector<size_t>                          _live;
+    std::vector<size_t>                          _free;
+    std::vector<size_t>                          _ranking;
+};
+
+#endif
@@ -8,12 +8,12 @@ FishCandidate::FishCandidate()
     , _score(1)
 {}
 
-FishCandidate::FishCandidate(FishPose& other, int score) : FishPose(other)
+FishCandidate::FishCandidate(const FishPose& other, int score) : FishPose(other)
 {
     _score = score;
 }
 
-FishCandidate::FishCandidate(FishCandidate& other) : FishPose(other)
+FishCandidate::FishCandidate(const FishCandidate& other) : FishPose(other)
 {
     _score = other.score();
 }
@@ -10,8 +10,8 @@ class FishCandidate	: public FishPose
 {
 public:
     FishCandidate();
-	FishCandidate(FishPose& other, int score);
-	FishCandidate(FishCandidate& other);
+	FishCandidate(const FishPose& other, int score);
+	FishCandidate(const FishCandidate& other);
     virtual ~FishCandidate() override {}
 
     void increaseScore();
@@ -14,7 +14,7 @@ FishPose::FishPose(size_t age, cv::RotatedRect position) {
     _last_known_position = position;
 }
 
-FishPose::FishPose(FishPose& other) {
+FishPose::FishPose(const FishPose& other) {
     _last_known_position = other.last_known_position();
     _age_of_last_known_position = other.age_of_last_known_position();
     _associated_color = other.associated_color();
@@ -49,7 +49,7 @@ void FishPose::setAngle(float angle) {
     _angle = angle;
 }
 
-float FishPose::angle() {
+float FishPose::angle() const {
     return _angle;
 }
 
@@ -10,7 +10,8 @@ class FishPose : public BioTracker::Core::ObjectModel {
 public:
     FishPose();
     FishPose(size_t age, cv::RotatedRect position);
-    FishPose(FishPose& other);
+    FishPose(const FishPose& other);
+    FishPose& operator=(const FishPose& other) = default;
     virtual ~FishPose() override {}
 
     static float _averageSpeed;
@@ -26,8 +27,9 @@ public:
     cv::Scalar associated_color() const;
 
     void setAngle(float angle);
-    float angle();
+    float angle() const;
 
+    // scalar reference for the batched IdentityCost used by the Mapper
     float calculateProbabilityOfIdentity(const cv::RotatedRect &second, float &distance, float angleImportance = 0.2f);
 
 protected:
@@ -0,0 +1,103 @@
+#include "ForegroundExtractor.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define FOREGROUND_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define FOREGROUND_NEON 1
+#endif
+
+namespace {
+
+// Each polarity is a functor so the per-pixel loop is instantiated once per
+// polarity and the choice is made once per frame instead of once per pixel.
+// All variants saturate like cv::subtract / cv::absdiff on 8 bit.
+
+struct DarkerDiff {
+    static uchar apply(uchar bg, uchar px) { return bg > px ? static_cast<uchar>(bg - px) : 0; }
+#ifdef FOREGROUND_SSE2
+    static __m128i apply(__m128i bg, __m128i px) { return _mm_subs_epu8(bg, px); }
+#elif defined(FOREGROUND_NEON)
+    static uint8x16_t apply(uint8x16_t bg, uint8x16_t px) { return vqsubq_u8(bg, px); }
+#endif
+};
+
+struct BrighterDiff {
+    static uchar apply(uchar bg, uchar px) { return px > bg ? static_cast<uchar>(px - bg) : 0; }
+#ifdef FOREGROUND_SSE2
+    static __m128i apply(__m128i bg, __m128i px) { return _mm_subs_epu8(px, bg); }
+#elif defined(FOREGROUND_NEON)
+    static uint8x16_t apply(uint8x16_t bg, uint8x16_t px) { return vqsubq_u8(px, bg); }
+#endif
+};
+
+struct AbsDiff {
+    static uchar apply(uchar bg, uchar px) { return bg > px ? static_cast<uchar>(bg - px) : static_cast<uchar>(px - bg); }
+#ifdef FOREGROUND_SSE2
+    static __m128i apply(__m128i bg, __m128i px) { return _mm_or_si128(_mm_subs_epu8(bg, px), _mm_subs_epu8(px, bg)); }
+#elif defined(FOREGROUND_NEON)
+    static uint8x16_t apply(uint8x16_t bg, uint8x16_t px) { return vabdq_u8(bg, px); }
+#endif
+};
+
+template <class Diff>
+void extractRow(const uchar *bg, const uchar *px, uchar *out, int width, uchar threshold) {
+    int x = 0;
+#ifdef FOREGROUND_SSE2
+    const __m128i t = _mm_set1_epi8(static_cast<char>(threshold));
+    for (; x <= width - 16; x += 16) {
+        const __m128i d = Diff::apply(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bg + x)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i *>(px + x)));
+        // d >= t  <=>  max(d, t) == d
+        const __m128i keep = _mm_cmpeq_epi8(_mm_max_epu8(d, t), d);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), _mm_and_si128(d, keep));
+    }
+#elif defined(FOREGROUND_NEON)
+    const uint8x16_t t = vdupq_n_u8(threshold);
+    for (; x <= width - 16; x += 16) {
+        const uint8x16_t d = Diff::apply(vld1q_u8(bg + x), vld1q_u8(px + x));
+        vst1q_u8(out + x, vandq_u8(d, vcgeq_u8(d, t)));
+    }
+#endif
+    for (; x < width; x++) {
+        const uchar d = Diff::apply(bg[x], px[x]);
+        out[x] = d >= threshold ? d : 0;
+    }
+}
+
+template <class Diff>
+void extractImage(const cv::Mat &background, const cv::Mat &frameGRAY, cv::Mat &foreground, uchar threshold) {
+    int rows = frameGRAY.rows;
+    int cols = frameGRAY.cols;
+    if (background.isContinuous() && frameGRAY.isContinuous() && foreground.isContinuous()) {
+        cols *= rows;
+        rows = 1;
+    }
+    for (int y = 0; y < rows; y++) {
+        extractRow<Diff>(background.ptr<uchar>(y), frameGRAY.ptr<uchar>(y), foreground.ptr<uchar>(y), cols, threshold);
+    }
+}
+
+}
+
+void ForegroundExtractor::extract(const cv::Mat &background, const cv::Mat &frameGRAY, cv::Mat &foreground,
+                                  Polarity polarity, uchar threshold)
+{
+    CV_Assert(background.type() == CV_8UC1 && frameGRAY.type() == CV_8UC1);
+    CV_Assert(background.size() == frameGRAY.size());
+
+    foreground.create(frameGRAY.size(), CV_8UC1);
+
+    switch (polarity) {
+    case Darker:
+        extractImage<DarkerDiff>(background, frameGRAY, foreground, threshold);
+        break;
+    case Brighter:
+        extractImage<BrighterDiff>(background, frameGRAY, foreground, threshold);
+        break;
+    case Both:
+        extractImage<AbsDiff>(background, frameGRAY, foreground, threshold);
+        break;
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef FOREGROUND_EXTRACTOR_H
+#define FOREGROUND_EXTRACTOR_H
+
+#include <opencv2/opencv.hpp>
+
+class ForegroundExtractor {
+public:
+    enum Polarity { Darker = 0, Brighter = 1, Both = 2 };
+
+    // Computes the polarity difference between background and frame (both CV_8UC1)
+    // and zeroes every pixel below threshold, in a single row-major pass.
+    // Thresholding to zero is monotone, so it commutes with the erosions and
+    // dilations applied afterwards and may safely run before them.
+    static void extract(const cv::Mat &background, const cv::Mat &frameGRAY, cv::Mat &foreground,
+                        Polarity polarity, uchar threshold);
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include "IdentityCost.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define IDENTITY_SSE2 1
+#endif
+
+namespace {
+
+const float Pi = static_cast<float>(CV_PI);
+const float TwoPi = static_cast<float>(2.0 * CV_PI);
+const float InvTwoPi = static_cast<float>(0.5 / CV_PI);
+const float Log2e = 1.44269504088896341f;
+const float ExpLowerLimit = -87.0f;
+
+// ln 2 split in two (Cody-Waite), so x - n ln 2 is exact enough for |n| up to 126
+const float Ln2Hi = 0.693359375f;
+const float Ln2Lo = -2.12194440e-4f;
+// exp(r) on [-ln 2 / 2, ln 2 / 2]: Taylor series up to the 6th order,
+// truncation error (ln 2 / 2)^7 / 7! < 1.3e-7
+const float C2 = 1.0f / 2.0f;
+const float C3 = 1.0f / 6.0f;
+const float C4 = 1.0f / 24.0f;
+const float C5 = 1.0f / 120.0f;
+const float C6 = 1.0f / 720.0f;
+
+// angle of the contour relative to the pose in [0, pi/2]: the direction of
+// the contour is unknown, so the closer of the two readings counts
+inline float axisDifference(float poseAngle, float contourAngle) {
+    float difference = poseAngle - contourAngle;
+    difference -= TwoPi * std::floor(difference * InvTwoPi + 0.5f);
+    difference = std::abs(difference);
+    return std::min(difference, Pi - difference);
+}
+
+}
+
+void ContourBatch::assign(const std::vector<cv::RotatedRect> &contours) {
+    x.resize(contours.size());
+    y.resize(contours.size());
+    angle.resize(contours.size());
+    const float degreesToRadians = static_cast<float>(CV_PI / 180.0);
+    for (size_t i = 0; i < contours.size(); i++) {
+        x[i] = contours[i].center.x;
+        y[i] = contours[i].center.y;
+        angle[i] = contours[i].angle * degreesToRadians;
+    }
+}
+
+void ContourBatch::gather(const ContourBatch &source, const std::vector<size_t> &indices) {
+    x.resize(indices.size());
+    y.resize(indices.size());
+    angle.resize(indices.size());
+    for (size_t k = 0; k < indices.size(); k++) {
+        x[k] = source.x[indices[k]];
+        y[k] = source.y[indices[k]];
+        angle[k] = source.angle[indices[k]];
+    }
+}
+
+IdentityCost::IdentityCost(float distanceSigma, float angleImportance)
+    : _distanceScale(-1.0f / (2.0f * distanceSigma * distanceSigma))
+    , _angleScale(0.0f)
+    , _angleImportance(angleImportance)
+{
+    const float angleSigma = static_cast<float>(10.0 * CV_PI / 2.0 * 0.05);
+    _angleScale = -1.0f / (2.0f * angleSigma * angleSigma);
+}
+
+void IdentityCost::evaluate(const cv::Point2f &center, float angle, const ContourBatch &contours,
+                            float *probability, float *distance) const
+{
+    const size_t count = contours.size();
+    const float *xs = contours.x.data();
+    const float *ys = contours.y.data();
+    const float *angles = contours.angle.data();
+    const float distanceWeight = 1.0f - _angleImportance;
+    size_t i = 0;
+
+#ifdef IDENTITY_SSE2
+    const __m128 cx = _mm_set1_ps(center.x);
+    const __m128 cy = _mm_set1_ps(center.y);
+    const __m128 ca = _mm_set1_ps(angle);
+    const __m128 pi = _mm_set1_ps(Pi);
+    const __m128 twoPi = _mm_set1_ps(TwoPi);
+    const __m128 invTwoPi = _mm_set1_ps(InvTwoPi);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 distanceScale = _mm_set1_ps(_distanceScale);
+    const __m128 angleScale = _mm_set1_ps(_angleScale);
+    const __m128 wd = _mm_set1_ps(distanceWeight);
+    const __m128 wa = _mm_set1_ps(_angleImportance);
+    const __m128 lowerLimit = _mm_set1_ps(ExpLowerLimit);
+    const __m128 log2e = _mm_set1_ps(Log2e);
+
+    // floor for the value ranges used here, SSE2 has no rounding instruction
+    auto floor4 = [one](__m128 v) {
+        const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), one));
+    };
+    auto exp4 = [&](__m128 v) {
+        const __m128 valid = _mm_cmpge_ps(v, lowerLimit);
+        v = _mm_max_ps(v, lowerLimit);
+        const __m128 n = floor4(_mm_add_ps(_mm_mul_ps(v, log2e), half));
+        __m128 r = _mm_sub_ps(v, _mm_mul_ps(n, _mm_set1_ps(Ln2Hi)));
+        r = _mm_sub_ps(r, _mm_mul_ps(n, _mm_set1_ps(Ln2Lo)));
+        __m128 p = _mm_set1_ps(C6);
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(C5));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(C4));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(C3));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(C2));
+        p = _mm_add_ps(_mm_mul_ps(p, r), one);
+        p = _mm_add_ps(_mm_mul_ps(p, r), one);
+        const __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+        return _mm_and_ps(_mm_mul_ps(p, _mm_castsi128_ps(exponent)), valid);
+    };
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128 dx = _mm_sub_ps(cx, _mm_loadu_ps(xs + i));
+        const __m128 dy = _mm_sub_ps(cy, _mm_loadu_ps(ys + i));
+        const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+        __m128 a = _mm_sub_ps(ca, _mm_loadu_ps(angles + i));
+        a = _mm_sub_ps(a, _mm_mul_ps(twoPi, floor4(_mm_add_ps(_mm_mul_ps(a, invTwoPi), half))));
+        a = _mm_and_ps(a, signMask);
+        a = _mm_min_ps(a, _mm_sub_ps(pi, a));
+
+        const __m128 p = _mm_add_ps(_mm_mul_ps(wd, exp4(_mm_mul_ps(d2, distanceScale))),
+                                    _mm_mul_ps(wa, exp4(_mm_mul_ps(_mm_mul_ps(a, a), angleScale))));
+        _mm_storeu_ps(probability + i, p);
+        _mm_storeu_ps(distance + i, _mm_sqrt_ps(d2));
+    }
+#endif
+
+    for (; i < count; i++) {
+        const float dx = center.x - xs[i];
+        const float dy = center.y - ys[i];
+        const float d2 = dx * dx + dy * dy;
+        const float a = axisDifference(angle, angles[i]);
+        probability[i] = distanceWeight * fastExp(d2 * _distanceScale) + _angleImportance * fastExp(a * a * _angleScale);
+        distance[i] = std::sqrt(d2);
+    }
+}
+
+float IdentityCost::fastExp(float x) {
+    if (!(x >= ExpLowerLimit)) {
+        return 0.0f;
+    }
+    // exp(x) = 2^n * exp(r) with n integer and |r| <= ln 2 / 2
+    const float n = std::floor(x * Log2e + 0.5f);
+    const float r = (x - n * Ln2Hi) - n * Ln2Lo;
+    const float p = ((((((C6 * r + C5) * r + C4) * r + C3) * r + C2) * r + 1.0f) * r + 1.0f);
+    const int32_t exponent = (static_cast<int32_t>(n) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &exponent, sizeof(scale));
+    return p * scale;
+}
@@ -0,0 +1,39 @@
+#ifndef IDENTITY_COST_H
+#define IDENTITY_COST_H
+
+#include <opencv2/opencv.hpp>
+
+// Contour ellipses as structure of arrays, angles already in radians.
+struct ContourBatch {
+    void assign(const std::vector<cv::RotatedRect> &contours);
+    // copies the given entries of source, in order
+    void gather(const ContourBatch &source, const std::vector<size_t> &indices);
+    size_t size() const { return x.size(); }
+
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> angle;
+};
+
+// Batched FishPose::calculateProbabilityOfIdentity: one pose against a whole
+// batch of contours, four lanes at a time where SSE2 is available and one at
+// a time elsewhere. Per pair the result equals the scalar version up to the
+// error of fastExp.
+class IdentityCost {
+public:
+    IdentityCost(float distanceSigma, float angleImportance = 0.2f);
+
+    // probability and distance receive contours.size() values
+    void evaluate(const cv::Point2f &center, float angle, const ContourBatch &contours,
+                  float *probability, float *distance) const;
+
+    // exp(x) for x <= 0 with a relative error below 3e-7 for x >= -87, 0 below
+    static float fastExp(float x);
+
+private:
+    float _distanceScale;
+    float _angleScale;
+    float _angleImportance;
+};
+
+#endif
@@ -1,133 +1,209 @@
 #include "Mapper.h"
 
-#include <QPainter>
-#include "SimpleTracker.h"
 #include "TrackedFish.h"
 
-#include <biotracker/Registry.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 
 using namespace BioTracker::Core;
 // ================= P U B L I C ====================
-Mapper::Mapper(std::vector<TrackedObject> &trackedObjects, size_t numberOfObjects, size_t framesTillPromotion) :
+Mapper::State::State() :
+    frame(0)
+    , trackCount(0)
+    , rng(0)
+    , candidates(0)
+{}
+
+Mapper::Mapper(std::vector<TrackedObject> &trackedObjects, size_t numberOfObjects, size_t framesTillPromotion,
+               size_t candidateCapacity) :
     m_trackedObjects(trackedObjects)
+    , _fishCandidates(candidateCapacity)
     , _numberOfObjects(numberOfObjects)
     , _framesTillPromotion(framesTillPromotion)
     , _lastId(1)
-{
-    _fishCandidates = std::vector<TrackedObject>();
-}
+    , _rng(12345)
+    , _activeFrame(0)
+    , _activeTrackCount(0)
+    , _activeValid(false)
+    , _allocationsLastFrame(PosePool::Counters{0, 0, 0})
+    , _restoredPoses(false)
+    , _journal(nullptr)
+    , _solver(new HungarianSolver())
+{}
 
 void Mapper::map(std::vector<cv::RotatedRect> &contourEllipses, size_t frame){
-    static cv::RNG rng(12345);
-    // (1) Find the next contour belonging to each tracked fish
-
-    std::vector<TrackedObject> fishes(m_trackedObjects);
-    for (size_t i = 0; i < fishes.size(); i++){
-        if(!fishes.at(i).hasValuesAtFrame(frame - 1)){
-            fishes.erase(fishes.begin() + i);
-            i--;
-        }
-    }
-    size_t nrOfObjectsInFrame = fishes.size();
-    std::vector<std::tuple<size_t, std::shared_ptr<FishPose>>> newFishes;
+    const PosePool::Counters allocationsBefore = PosePool::instance().counters();
+    // cells of the smallest gate, older poses just look a few cells further
+    _contourGrid.build(contourEllipses, 3 * FishPose::_averageSpeed);
+    _contourBatch.assign(contourEllipses);
+    _contourAssigned.assign(contourEllipses.size(), 0);
 
-    while(!fishes.empty() && !contourEllipses.empty()) {
-        newFishes.push_back(mergeContoursToFishes(0, frame - 1, fishes, contourEllipses, std::vector<size_t>()));
-    }
-
-	for (size_t j = 0; j < m_trackedObjects.size(); j++) {
-    //for(size_t i = 0; i < newFishes.size(); i++){
-        //for(size_t j = 0; j < m_trackedObjects.size(); j++){
-		for (size_t i = 0; i < newFishes.size(); i++) {
-			size_t id;
-			std::shared_ptr<FishPose> fp;
-			std::tie(id, fp) = newFishes[i];
-            if(id == m_trackedObjects[j].getId()){
-                if(!fp){
-                    continue;
-                }
-                m_trackedObjects[j].add(frame, fp);
+    // (1) Find the next contour belonging to each tracked fish
+    updateActiveTracks(frame);
+    size_t nrOfObjectsInFrame = _activeTracks.size();
+
+    predictTracks(frame);
+    const std::vector<int> &newFishes = associate(contourEllipses);
+    const MotionNoise noise = motionNoise();
+
+    // a track without a pose in this frame is never picked up again
+    size_t stillActive = 0;
+    for (size_t k = 0; k < _activeTracks.size(); k++) {
+        if(newFishes[k] >= 0){
+            const cv::RotatedRect &contour = contourEllipses[static_cast<size_t>(newFishes[k])];
+            TrackedObject &trackedObject = m_trackedObjects[_activeTracks[k]];
+            auto newFish = allocatePose<FishPose>();
+            newFish->setNextPosition(contour);
+            newFish->setAngle(contour.angle * (static_cast<float>(CV_PI) / 180.0f));
+            newFish->set_associated_color(trackedObject.get<FishPose>(frame - 1)->associated_color());
+            trackedObject.add(frame, newFish);
+            if (_journal) {
+                _journal->pose(trackedObject.getId(), frame, *newFish);
+            }
+            _motion[_activeTracks[k]].update(contour.center, noise);
+            _activeTracks[stillActive++] = _activeTracks[k];
+        } else {
+            // a lost track is never trimmed by (4) again, so all of it goes
+            const size_t id = m_trackedObjects[_activeTracks[k]].getId();
+            if (_trackRetainedFrom.size() < m_trackedObjects.size()) {
+                _trackRetainedFrom.resize(m_trackedObjects.size(), std::numeric_limits<size_t>::max());
+            }
+            _retention.retire(m_trackedObjects[_activeTracks[k]], _trackRetainedFrom[_activeTracks[k]]);
+            if (_journal) {
+                _journal->lost(id, frame);
             }
         }
-//		if (!m_trackedObjects[j].hasValuesAtFrame(frame)) {
-//			std::shared_ptr<FishPose> a = std::make_shared<FishPose>(*(m_trackedObjects[j].get<FishPose>(frame - 1).get()));
-//			a->setNextPositionUnknown();
-//			m_trackedObjects[j].add(frame, a);
-//		}
     }
+    _activeTracks.resize(stillActive);
 
     // (2) Try to find contours belonging to fish candidates, promoting to FishPose as appropriate
     if (nrOfObjectsInFrame < _numberOfObjects) {
-        for(size_t i = 0; i < _fishCandidates.size(); i++){
-            if(!_fishCandidates[i].hasValuesAtFrame(frame - 1)){
-                _fishCandidates.erase(_fishCandidates.begin() + i);
-                i--;
+        std::vector<TrackedObject> &candidates = _fishCandidates.slots();
+        for (size_t k = _fishCandidates.size(); k-- > 0;) {
+            const size_t slot = _fishCandidates.live()[k];
+            if (!candidates[slot].hasValuesAtFrame(frame - 1)) {
+                _fishCandidates.drop(_fishCandidates.handle(slot));
             }
         }
-        std::vector<TrackedObject> fishCandidates(_fishCandidates);
-        std::vector<std::tuple<size_t, std::shared_ptr<FishPose>>> newFishCandidates;
-
-        while(!fishCandidates.empty() && !contourEllipses.empty()) {
-            newFishCandidates.push_back(mergeContoursToFishes(0, frame - 1, fishCandidates, contourEllipses,
-                                                              std::vector<size_t>()));
-        }
-
-        for(size_t j = 0; j < _fishCandidates.size(); j++){
-            for(size_t i = 0; i < newFishCandidates.size(); i++){
-                size_t id;
-                std::shared_ptr<FishPose> fp;
-                std::tie(id, fp) = newFishCandidates[i];
-                if(id == _fishCandidates[j].getId()){
-                    if(!fp){
-                        continue;
-                    }
-                    std::shared_ptr<FishCandidate> a = std::make_shared<FishCandidate>(*fp.get(),
-                                                                                       _fishCandidates[j].get<FishCandidate>(frame - 1)->score());
-                    a->increaseScore();
-                    _fishCandidates[j].add(frame, a);
-                }
-            }
-            if(!_fishCandidates[j].hasValuesAtFrame(frame)){
-                std::shared_ptr<FishCandidate> a = std::make_shared<FishCandidate>(*(_fishCandidates[j].get<FishCandidate>(frame-1).get()));
+        // dropping reorders live(), so work on a copy
+        _candidateView = _fishCandidates.live();
+        predictCandidates(frame);
+        const std::vector<int> &newFishCandidates = associate(contourEllipses);
+
+        for(size_t j = 0; j < _candidateView.size(); j++){
+            TrackedObject &candidate = candidates[_candidateView[j]];
+            const std::shared_ptr<FishCandidate> previous = candidate.get<FishCandidate>(frame - 1);
+            // keeps the color and score of the previous frame
+            std::shared_ptr<FishCandidate> a = allocatePose<FishCandidate>(*previous);
+            if(newFishCandidates[j] >= 0){
+                const cv::RotatedRect &contour = contourEllipses[static_cast<size_t>(newFishCandidates[j])];
+                a->setNextPosition(contour);
+                a->setAngle(contour.angle * (static_cast<float>(CV_PI) / 180.0f));
+                a->increaseScore();
+            } else {
                 a->setNextPositionUnknown();
-                _fishCandidates[j].add(frame, a);
             }
+            candidate.add(frame, a);
+            _candidateStatistics[_candidateView[j]].add(candidate.getId(), frame, *a);
+            _fishCandidates.setScore(_fishCandidates.handle(_candidateView[j]), a->score());
         }
-        // (2.5) Drop/Promote candidates.
-        for(int i = 0; i < static_cast<int>(_fishCandidates.size()) && nrOfObjectsInFrame < _numberOfObjects; i++){
-            if(_fishCandidates[i].hasValuesAtFrame(frame)){
-                // TODO: Score Threshold needed
-                int score = _fishCandidates[i].get<FishCandidate>(frame)->score();
-                if(static_cast<size_t>(score) >= _framesTillPromotion){
-                    std::move(_fishCandidates.begin() + i, _fishCandidates.begin() + i + 1, std::back_inserter(m_trackedObjects));
-                    _fishCandidates.erase(_fishCandidates.begin() + i);
-                    i--;
-                    nrOfObjectsInFrame++;
-                } else if (score < 0){
-                    _fishCandidates.erase(_fishCandidates.begin() + i);
-                    i--;
+        // (2.5) Drop/Promote candidates
+        _promotions.clear();
+        for(size_t i = 0; i < _candidateView.size() && nrOfObjectsInFrame < _numberOfObjects; i++){
+            const CandidateStore::Handle handle = _fishCandidates.handle(_candidateView[i]);
+            // TODO: Score Threshold needed
+            int score = candidates[_candidateView[i]].get<FishCandidate>(frame)->score();
+            if(score >= 0 && static_cast<size_t>(score) >= _framesTillPromotion){
+                _promotions.push_back(handle);
+                nrOfObjectsInFrame++;
+            } else if (score < 0){
+                _fishCandidates.drop(handle);
+            }
+        }
+        for (size_t k = 0; k < _promotions.size(); k++) {
+            _activeTracks.push_back(m_trackedObjects.size() + k);
+            if (_journal) {
+                // the track starts with the history it gathered as a candidate
+                TrackedObject &candidate = _fishCandidates.get(_promotions[k]);
+                size_t first = frame;
+                while (first > 0 && candidate.hasValuesAtFrame(first - 1)) {
+                    first--;
+                }
+                _journal->promotion(candidate.getId(), frame);
+                for (size_t i = first; i <= frame; i++) {
+                    _journal->pose(candidate.getId(), i, *candidate.get<FishPose>(i));
                 }
-            } else {
-                _fishCandidates.erase(_fishCandidates.begin() + i);
-                i--;
             }
         }
+        _fishCandidates.promote(_promotions, m_trackedObjects);
 
         // (3) Create new candidates for unmatched contours
-        for (cv::RotatedRect& contour : contourEllipses) {
-            BioTracker::Core::TrackedObject newObject(_lastId);
-            _lastId++;
-            auto newFish = std::make_shared<FishCandidate>();
+        size_t kept = 0;
+        for (size_t j = 0; j < contourEllipses.size(); j++) {
+            if (!_contourAssigned[j]) {
+                contourEllipses[kept++] = contourEllipses[j];
+            }
+        }
+        contourEllipses.resize(kept);
+        // fresh candidates only displace ones that never scored more than they start with
+        const int initialScore = FishCandidate().score();
+        const size_t room = _fishCandidates.makeRoom(contourEllipses.size(), initialScore);
+        for (size_t j = 0; j < room; j++) {
+            const cv::RotatedRect &contour = contourEllipses[j];
+            const size_t id = _lastId++;
+            BioTracker::Core::TrackedObject newObject(id);
+            auto newFish = allocatePose<FishCandidate>();
             newFish->setNextPosition(contour);
-            newFish->set_associated_color(cv::Scalar(rng.uniform(0, 255), rng.uniform(0, 255), rng.uniform(0, 255)));
+            newFish->set_associated_color(cv::Scalar(_rng.uniform(0, 255), _rng.uniform(0, 255), _rng.uniform(0, 255)));
             newFish->setAngle(contour.angle * (static_cast<float>(CV_PI) / 180.0f));
             newObject.add(frame, newFish);
-            _fishCandidates.push_back(newObject);
+            const CandidateStore::Handle handle = _fishCandidates.spawn(std::move(newObject), newFish->score());
+            if (_candidateStatistics.size() <= handle.slot) {
+                _candidateStatistics.resize(handle.slot + 1);
+            }
+            TrackStatistics &statistics = _candidateStatistics[handle.slot];
+            statistics.start(id);
+            statistics.add(id, frame, *newFish);
+            if (_candidateRetainedFrom.size() <= handle.slot) {
+                _candidateRetainedFrom.resize(handle.slot + 1);
+            }
+            _candidateRetainedFrom[handle.slot] = frame;
         }
     }
     if (nrOfObjectsInFrame >= _numberOfObjects) {
         _fishCandidates.clear();
     }
+
+    // (4) Keep only the retention window in memory
+    if (_retention.window() > 0) {
+        _trackRetainedFrom.resize(m_trackedObjects.size(), std::numeric_limits<size_t>::max());
+        if (_restoredPoses) {
+            retainAllTracks(frame);
+        }
+        for (size_t index : _activeTracks) {
+            _retention.retain(m_trackedObjects[index], frame, _trackRetainedFrom[index], true);
+        }
+        std::vector<TrackedObject> &candidates = _fishCandidates.slots();
+        _candidateRetainedFrom.resize(candidates.size(), std::numeric_limits<size_t>::max());
+        for (size_t slot : _fishCandidates.live()) {
+            _retention.retain(candidates[slot], frame, _candidateRetainedFrom[slot], false);
+        }
+    }
+
+    _activeFrame = frame + 1;
+    _activeTrackCount = m_trackedObjects.size();
+    _activeValid = true;
+
+    if (_journal) {
+        _journal->commit(frame);
+    }
+
+    const PosePool::Counters allocationsAfter = PosePool::instance().counters();
+    _allocationsLastFrame.allocations = allocationsAfter.allocations - allocationsBefore.allocations;
+    _allocationsLastFrame.heapAllocations = allocationsAfter.heapAllocations - allocationsBefore.heapAllocations;
+    _allocationsLastFrame.live = allocationsAfter.live;
 }
 
 
@@ -137,131 +213,347 @@ void Mapper::setNumberOfObjects(size_t numberOfObjects){
 void Mapper::setFramesTillPromotion(size_t framesTillPromotion){
     _framesTillPromotion = framesTillPromotion;
 }
+void Mapper::setCandidateCapacity(size_t candidateCapacity){
+    _fishCandidates.setCapacity(candidateCapacity);
+}
+void Mapper::setRetentionWindow(size_t retentionWindow){
+    _retention.setWindow(retentionWindow);
+}
+void Mapper::setArchiveSpill(bool spill){
+    _retention.setSpill(spill);
+}
+void Mapper::setJournal(PoseJournal *journal){
+    _journal = journal;
+}
 
-std::vector<BioTracker::Core::TrackedObject>& Mapper::getFishCandidates(){
+CandidateStore& Mapper::getFishCandidates(){
     return _fishCandidates;
 }
 
-// ================ P R I V A T E ===================
+void Mapper::setAssociationSolver(std::unique_ptr<AssociationSolver> solver){
+    _solver = std::move(solver);
+}
 
-std::tuple<size_t, std::shared_ptr<FishPose>> Mapper::mergeContoursToFishes(size_t fishIndex, size_t frame,
-                                                                            std::vector<TrackedObject> &fishes,
-                                                                            std::vector<cv::RotatedRect> &contourEllipses,
-                                                                            std::vector<size_t> alreadyTestedIndizies)
-{
-    TrackedFish trackedFish = static_cast<TrackedFish&>(fishes.at(fishIndex));
-    size_t trackedId = trackedFish.getId();
+void Mapper::invalidateTrackCaches(){
+    for (const TrackedObject &trackedObject : m_trackedObjects) {
+        _lastId = std::max(_lastId, trackedObject.getId() + 1);
+    }
+    _motion.clear();
+    for (TrackStatistics &statistics : _candidateStatistics) {
+        statistics.clear();
+    }
+    _activeValid = false;
+    // the archive belongs to the tracks that were replaced
+    _retention.clear();
+    _trackRetainedFrom.clear();
+    _candidateRetainedFrom.clear();
+    _restoredPoses = true;
+}
 
-    int np(-1);
-    float score(0);
+std::shared_ptr<FishPose> Mapper::getPose(size_t track, size_t frame){
+    TrackedObject &trackedObject = m_trackedObjects[track];
+    if (trackedObject.hasValuesAtFrame(frame)) {
+        return trackedObject.get<FishPose>(frame);
+    }
+    return _retention.archived(trackedObject.getId(), frame);
+}
 
-    std::tie(np, score) = getNearestIndexFromFishPoses(trackedFish.getPoseForMapping(frame), contourEllipses);
+void Mapper::restoreArchivedPoses(){
+    _retention.restore(m_trackedObjects);
+    _trackRetainedFrom.clear();
+    _restoredPoses = true;
+}
 
-    if(np == -1){
-        fishes.erase(fishes.begin() + fishIndex);
-        return std::make_tuple(trackedId, nullptr);
-    }
-//    if(score < 0.3){
-//        fishes.erase(fishes.begin() + fishIndex);
-//        return std::make_tuple(trackedFish.getId(), std::make_shared<FishPose>(*(trackedFish.get<FishPose>(frame).get())));
-//    }
-
-    auto fp = std::make_shared<FishPose>(trackedFish.get<FishPose>(frame)->age_of_last_known_position(),
-                                         contourEllipses.at(np));
-//    fp->setNextPosition(contourEllipses.at(np));
-    fp->setAngle(contourEllipses.at(np).angle * (static_cast<float>(CV_PI) / 180.0f));
-
-    if(std::find(alreadyTestedIndizies.begin(), alreadyTestedIndizies.end(), fishIndex) == alreadyTestedIndizies.end()){
-        auto newFish = std::make_shared<FishPose>();
-        newFish->setNextPosition(contourEllipses[np]);
-        newFish->setAngle(contourEllipses[np].angle * (static_cast<float>(CV_PI) / 180.0f));
-        newFish->set_associated_color(fishes[fishIndex].get<FishPose>(frame)->associated_color());
-
-        fishes.erase(fishes.begin() + fishIndex);
-        contourEllipses.erase(contourEllipses.begin() + np);
-
-        return std::make_tuple(trackedId, newFish);
+void Mapper::archiveRestoredPoses(){
+    if (_restoredPoses && _retention.window() > 0 && _activeFrame > 0) {
+        retainAllTracks(_activeFrame - 1);
     }
+}
+
+void Mapper::saveState(size_t frame, State &state) const{
+    state.frame = frame;
+    state.trackCount = m_trackedObjects.size();
+    state.rng = _rng.state;
+    state.candidates = _fishCandidates;
+    state.candidateRetainedFrom = _candidateRetainedFrom;
+}
 
-    std::vector<cv::RotatedRect> fps;
-    for(size_t i = 0; i < fishes.size(); i++)
-    {
-        if(fishes[i].hasValuesAtFrame(frame)){
-            TrackedFish& tFish = static_cast<TrackedFish&>(fishes.at(i));
-//            FishPose tmpFish = tFish.getPoseForMapping(frame);
-            FishPose tmpFish = *(tFish.get<FishPose>(frame).get());
-            cv::RotatedRect tmpRect(tmpFish.last_known_position().center, tmpFish.last_known_position().size, tmpFish.angle());
-            fps.push_back(tmpRect);
+void Mapper::rewind(size_t frame){
+    // the archive has to be back in the tracks before they are cut
+    _retention.restore(m_trackedObjects);
+    _trackRetainedFrom.clear();
+    _restoredPoses = true;
+
+    // tracks have a pose every frame from their first candidate pose to the
+    // last one; a candidate pose at frame means the promotion came later
+    std::vector<size_t> dropped;
+    size_t kept = 0;
+    for (size_t i = 0; i < m_trackedObjects.size(); i++) {
+        TrackedObject &trackedObject = m_trackedObjects[i];
+        const boost::optional<size_t> lastFrame = trackedObject.getLastFrameNumber();
+        if (lastFrame && lastFrame.get() >= frame) {
+            if (frame == 0 || !trackedObject.hasValuesAtFrame(frame - 1) ||
+                (trackedObject.hasValuesAtFrame(frame) && trackedObject.get<FishCandidate>(frame))) {
+                dropped.push_back(trackedObject.getId());
+                continue;
+            }
+            TrackedObject cut(trackedObject.getId());
+            for (size_t j = 0; j < frame; j++) {
+                if (trackedObject.hasValuesAtFrame(j)) {
+                    cut.add(j, trackedObject.get<ObjectModel>(j));
+                }
+            }
+            trackedObject = std::move(cut);
         }
+        if (kept != i) {
+            m_trackedObjects[kept] = std::move(trackedObject);
+        }
+        kept++;
+    }
+    m_trackedObjects.erase(m_trackedObjects.begin() + static_cast<std::ptrdiff_t>(kept), m_trackedObjects.end());
+
+    // _lastId stays, so the ids of the dropped tracks are not handed out again
+    _fishCandidates.clear();
+    _candidateRetainedFrom.clear();
+    for (TrackStatistics &statistics : _candidateStatistics) {
+        statistics.clear();
     }
+    // rebuilt from the kept poses when the tracks are next predicted
+    _motion.clear();
+    _activeValid = false;
+    _activeFrame = frame;
 
-    int fpt;
-    float fptScore;
-    std::tie(fpt, fptScore) = getNearestIndexFromFishPoses(*(fp.get()), fps);
+    if (_journal) {
+        _journal->rollback(frame, dropped);
+    }
+}
 
-    if(fpt == static_cast<int>(fishIndex)) {
-//        trackedFish.correctAngle(frame, contourEllipses[np]);
-        auto newFish = std::make_shared<FishPose>();
-        newFish->setNextPosition(contourEllipses[np]);
-        newFish->setAngle(contourEllipses[np].angle * (static_cast<float>(CV_PI) / 180.0f));
-        newFish->set_associated_color(fishes[fishIndex].get<FishPose>(frame)->associated_color());
+void Mapper::restoreState(const State &state, size_t frame){
+    rewind(frame);
+    // after a longer gap the candidates would come back with an age that
+    // gates the whole frame and a coasted history that never happened
+    if (state.frame >= frame || frame - 1 - state.frame > _framesTillPromotion) {
+        return;
+    }
 
-        fishes.erase(fishes.begin() + fishIndex);
-        contourEllipses.erase(contourEllipses.begin() + np);
+    // candidates promoted since are tracks now
+    _fishCandidates = state.candidates;
+    _candidateRetainedFrom = state.candidateRetainedFrom;
+    std::vector<TrackedObject> &candidates = _fishCandidates.slots();
+    for (size_t k = _fishCandidates.size(); k-- > 0;) {
+        const size_t slot = _fishCandidates.live()[k];
+        for (size_t i = std::min(state.trackCount, m_trackedObjects.size()); i < m_trackedObjects.size(); i++) {
+            if (m_trackedObjects[i].getId() == candidates[slot].getId()) {
+                _fishCandidates.drop(_fishCandidates.handle(slot));
+                break;
+            }
+        }
+    }
+    _rng.state = state.rng;
 
-        return std::make_tuple(trackedId, newFish);
-    } else {
-        alreadyTestedIndizies.push_back(fishIndex);
-        return mergeContoursToFishes(fpt, frame, fishes, contourEllipses, alreadyTestedIndizies);
+    for (size_t i = state.frame + 1; i < frame; i++) {
+        coastCandidates(i);
     }
 }
 
-std::tuple<int , float> Mapper::getNearestIndexFromFishPoses(FishPose &fishPose,
-                                                                const std::vector<cv::RotatedRect> &fishPoses)
-{
-    // for readability
-    typedef std::tuple<int, float> PoseScoreTuple;
-    enum { PoseIndex = 0, ScoreIndex = 1 };
+PosePool::Counters Mapper::allocationsLastFrame() const{
+    return _allocationsLastFrame;
+}
 
-    PoseScoreTuple bestTwo[] = { std::make_tuple(-1, -1.0f), std::make_tuple(-1, -1.0f) };
+bool Mapper::predictSearchWindows(size_t frame, const cv::Size &imageSize, std::vector<cv::Rect> &windows){
+    windows.clear();
+    if (frame == 0) {
+        return false;
+    }
+    const cv::Rect image(cv::Point(0, 0), imageSize);
+    updateActiveTracks(frame);
+    predictTracks(frame);
+    for (const Prediction &prediction : _predictions) {
+        const cv::RotatedRect &position = prediction.position;
+        if (!std::isfinite(position.center.x) || !std::isfinite(position.center.y)) {
+            return false;
+        }
+        // same gate as associate(), widened by the body
+        // length so the whole blob around an accepted center is covered
+        const float reach = prediction.gate + std::max(position.size.width, position.size.height);
+        const cv::Rect window = cv::Rect(cv::Point(cvFloor(position.center.x - reach), cvFloor(position.center.y - reach)),
+                                         cv::Point(cvCeil(position.center.x + reach) + 1, cvCeil(position.center.y + reach) + 1))
+                                & image;
+        if (window.area() == 0) {
+            return false;
+        }
+        windows.push_back(window);
+    }
+    return !windows.empty() && windows.size() >= _numberOfObjects;
+}
 
-    for(size_t i = 0; i < fishPoses.size(); i++)
-    {
-        const cv::RotatedRect &possiblePose = fishPoses[i];
-        // this takes angle-direction correction into account
-        float distance = -1.0f;
-        const float probabilityOfIdentity = fishPose.calculateProbabilityOfIdentity(possiblePose, distance);
+// ================ P R I V A T E ===================
+
+void Mapper::coastCandidates(size_t frame){
+    std::vector<TrackedObject> &candidates = _fishCandidates.slots();
+    for (size_t slot : _fishCandidates.live()) {
+        TrackedObject &candidate = candidates[slot];
+        if (candidate.hasValuesAtFrame(frame - 1)) {
+            auto pose = allocatePose<FishCandidate>(*candidate.get<FishCandidate>(frame - 1));
+            pose->setNextPositionUnknown();
+            candidate.add(frame, pose);
+        }
+    }
+    _activeFrame = frame + 1;
+}
+
+void Mapper::retainAllTracks(size_t frame){
+    _trackRetainedFrom.resize(m_trackedObjects.size(), std::numeric_limits<size_t>::max());
+    for (size_t index = 0; index < m_trackedObjects.size(); index++) {
+        TrackedObject &trackedObject = m_trackedObjects[index];
+        // an ended track gets no more poses, so all of it can be archived
+        if (trackedObject.hasValuesAtFrame(frame)) {
+            _retention.retain(trackedObject, frame, _trackRetainedFrom[index], true);
+        } else {
+            _retention.retire(trackedObject, _trackRetainedFrom[index]);
+        }
+    }
+    _restoredPoses = false;
+}
 
-        if(distance > 3 * FishPose::_averageSpeed * fishPose.age_of_last_known_position()){
-            continue;
+void Mapper::updateActiveTracks(size_t frame){
+    if (_activeValid && _activeFrame == frame && _activeTrackCount == m_trackedObjects.size()) {
+        return;
+    }
+    _activeTracks.clear();
+    for (size_t i = 0; i < m_trackedObjects.size(); i++) {
+        if (m_trackedObjects[i].hasValuesAtFrame(frame - 1)) {
+            _activeTracks.push_back(i);
         }
+    }
+    _activeFrame = frame;
+    _activeTrackCount = m_trackedObjects.size();
+    _activeValid = true;
+}
+
+MotionNoise Mapper::motionNoise(){
+    // a quarter of the typical step as center jitter, half of it as the
+    // change in velocity from one frame to the next; fish turn and dart, so
+    // a steady track still gets a 3 sigma gate of about two steps
+    const float step = FishPose::_averageSpeed;
+    return MotionNoise{0.25f * step * step, 0.0625f * step * step};
+}
 
-        // figure out whether the probability is the new highest or second highest
-        if (probabilityOfIdentity > std::get<ScoreIndex>(bestTwo[0])) // new best?
-        {
-            // move current best to second place
-            bestTwo[1] = bestTwo[0];
-            // and remember new best one
-            bestTwo[0] = std::make_tuple(static_cast<int>(i), probabilityOfIdentity);
+MotionModel &Mapper::motionModel(size_t track, size_t frame){
+    if (_motion.size() < m_trackedObjects.size()) {
+        _motion.resize(m_trackedObjects.size());
+    }
+    MotionModel &model = _motion[track];
+    if (model.frame() == frame - 1) {
+        return model;
+    }
+
+    // new tracks (promoted candidates, loaded data) replay a few poses, which
+    // is enough for the velocity to settle
+    const size_t historyWindow = 10;
+    const TrackedObject &trackedObject = m_trackedObjects[track];
+    size_t first = frame - 1;
+    while (frame - 1 - first < historyWindow && first > 0 && trackedObject.hasValuesAtFrame(first - 1)) {
+        first--;
+    }
+    const MotionNoise noise = motionNoise();
+    model.initialize(trackedObject.get<FishPose>(first)->last_known_position().center, first, noise,
+                     FishPose::_averageSpeed * FishPose::_averageSpeed);
+    for (size_t i = first + 1; i < frame; i++) {
+        const std::shared_ptr<FishPose> pose = trackedObject.get<FishPose>(i);
+        if (pose->age_of_last_known_position() == 1) {
+            model.update(pose->last_known_position().center, noise);
+        } else {
+            model.coast(noise);
         }
-        else if (probabilityOfIdentity > std::get<ScoreIndex>(bestTwo[1])) // new second place?
-        {
-            bestTwo[1] = std::make_tuple(static_cast<int>(i), probabilityOfIdentity);
+    }
+    return model;
+}
+
+void Mapper::predictTracks(size_t frame){
+    const MotionNoise noise = motionNoise();
+    // a contour is admitted within gateSigmas Mahalanobis distance of the
+    // filter's prediction. The innovation covariance is the same for both
+    // axes, so that is a circle of gateSigmas innovation deviations; the
+    // floor of one average step only keeps an overconfident filter from
+    // shrinking it below the measurement jitter
+    const float gateSigmas = 3.0f;
+    const float minimumGate = FishPose::_averageSpeed;
+    _predictions.resize(_activeTracks.size());
+    for (size_t k = 0; k < _activeTracks.size(); k++) {
+        const std::shared_ptr<FishPose> pose = m_trackedObjects[_activeTracks[k]].get<FishPose>(frame - 1);
+        const MotionModel &model = motionModel(_activeTracks[k], frame);
+        const float filterGate = gateSigmas * std::sqrt(model.innovationVariance(noise));
+        const cv::Point2f predicted = model.predictedPosition();
+
+        Prediction &prediction = _predictions[k];
+        prediction.position = cv::RotatedRect(predicted, pose->last_known_position().size, pose->angle());
+        prediction.angle = pose->angle();
+        prediction.gate = std::max(filterGate, minimumGate);
+    }
+}
+
+void Mapper::predictCandidates(size_t frame){
+    std::vector<TrackedObject> &candidates = _fishCandidates.slots();
+    if (_candidateStatistics.size() < candidates.size()) {
+        _candidateStatistics.resize(candidates.size());
+    }
+    _predictions.resize(_candidateView.size());
+    for (size_t k = 0; k < _candidateView.size(); k++) {
+        TrackedFish &trackedFish = static_cast<TrackedFish&>(candidates[_candidateView[k]]);
+        TrackStatistics &statistics = _candidateStatistics[_candidateView[k]];
+        if (!statistics.current(trackedFish.getId(), frame - 1)) {
+            statistics.load(trackedFish, frame - 1);
         }
+        const FishPose pose = trackedFish.getPoseForMapping(frame - 1, &statistics);
+        Prediction &prediction = _predictions[k];
+        prediction.position = pose.last_known_position();
+        prediction.angle = pose.angle();
+        prediction.gate = 3 * FishPose::_averageSpeed * pose.age_of_last_known_position();
     }
-    // score defaults to the probability of identity if only one pose was found
-    float score = std::get<ScoreIndex>(bestTwo[0]);
-
-    if (std::get<PoseIndex>(bestTwo[1]) != -1) // second pose found?
-    {
-        score = score / (score + std::get<ScoreIndex>(bestTwo[1]));
-        // this will now always be above 50%, so rescale a bit
-        score = 2.0f * (score - 0.5f);
+}
+
+const std::vector<int> &Mapper::associate(const std::vector<cv::RotatedRect> &contourEllipses)
+{
+    if (std::find(_contourAssigned.begin(), _contourAssigned.end(), 0) == _contourAssigned.end()) {
+        _assignment.assign(_predictions.size(), -1);
+        return _assignment;
     }
 
-    if(std::isnan(score)){
-        score = 0;
+    // one gated cost per admissible (object, contour) pair
+    const IdentityCost identityCost(FishPose::_averageSpeedSigma);
+    _edges.clear();
+    for (size_t i = 0; i < _predictions.size(); i++) {
+        const Prediction &prediction = _predictions[i];
+        const float gate = prediction.gate;
+        _contourGrid.query(prediction.position.center, gate, _nearbyContours);
+        _nearbyContours.erase(std::remove_if(_nearbyContours.begin(), _nearbyContours.end(),
+                                             [this](size_t j) { return _contourAssigned[j] != 0; }),
+                              _nearbyContours.end());
+
+        // same score as FishPose::calculateProbabilityOfIdentity, for all nearby contours at once
+        _nearbyBatch.gather(_contourBatch, _nearbyContours);
+        _probabilities.resize(_nearbyContours.size());
+        _distances.resize(_nearbyContours.size());
+        identityCost.evaluate(prediction.position.center, prediction.angle, _nearbyBatch,
+                              _probabilities.data(), _distances.data());
+        for (size_t k = 0; k < _nearbyContours.size(); k++) {
+            if (!(_distances[k] <= gate) || !std::isfinite(_probabilities[k])) {
+                continue;
+            }
+            _edges.push_back({i, _nearbyContours[k], 1.0 - _probabilities[k]});
+        }
+    }
+
+    // costs are within [0, 1], so any gated contour beats leaving an object unmatched
+    const double unmatchedCost = 2.0;
+    _solver->solve(_predictions.size(), contourEllipses.size(), _edges, unmatchedCost, _assignment);
+
+    for (size_t i = 0; i < _predictions.size(); i++) {
+        if (_assignment[i] >= 0) {
+            _contourAssigned[static_cast<size_t>(_assignment[i])] = 1;
+        }
     }
 
-    return std::make_tuple(std::get<PoseIndex>(bestTwo[0]), score);
+    return _assignment;
 }
@@ -5,37 +5,169 @@
 
 #include "FishPose.h"
 #include "FishCandidate.h"
+#include "Association.h"
+#include "SpatialGrid.h"
+#include "IdentityCost.h"
+#include "PosePool.h"
+#include "CandidateStore.h"
+#include "MotionModel.h"
+#include "TrackStatistics.h"
+#include "PoseRetention.h"
+#include "PoseJournal.h"
 
 #include <biotracker/serialization/TrackedObject.h>
 
 class Mapper {
 public:
+    // the candidates map() carries over from one frame to the next; the
+    // tracks keep their own history. Poses are shared with the candidates, so
+    // a state costs little more than the candidate store.
+    struct State {
+        State();
+
+        size_t                      frame;
+        size_t                      trackCount;
+        uint64_t                    rng;
+        CandidateStore              candidates;
+        std::vector<size_t>         candidateRetainedFrom;
+    };
+
     Mapper(std::vector<BioTracker::Core::TrackedObject> &trackedObjects,
-           size_t numberOfObjects, size_t framesTillPromotion);
+           size_t numberOfObjects, size_t framesTillPromotion, size_t candidateCapacity = 512);
 
 	void map(std::vector<cv::RotatedRect> &contourEllipses, size_t frame);
 
     void setNumberOfObjects(size_t numberOfObjects);
     void setFramesTillPromotion(size_t framesTillPromotion);
+    void setCandidateCapacity(size_t candidateCapacity);
+    // frames of each track kept as poses, older poses of tracks are archived
+    // in columns and those of candidates discarded; 0 keeps everything
+    void setRetentionWindow(size_t retentionWindow);
+    // archive to a scratch file instead of in memory
+    void setArchiveSpill(bool spill);
+    // records every frame's new track poses, promotions and lost tracks;
+    // nullptr (the default) records nothing
+    void setJournal(PoseJournal *journal);
+
+    // Image regions that contain every contour map() could assign to a track in
+    // the given frame, i.e. the gating area around each predicted pose.
+    // Returns false if the full frame is needed (too few tracks to skip
+    // looking for new candidates).
+    bool predictSearchWindows(size_t frame, const cv::Size &imageSize, std::vector<cv::Rect> &windows);
+
+    CandidateStore& getFishCandidates();
+
+    // engine used to associate contours with tracks and candidates, HungarianSolver by default
+    void setAssociationSolver(std::unique_ptr<AssociationSolver> solver);
 
-    std::vector<BioTracker::Core::TrackedObject>& getFishCandidates();
+    // drops everything derived from the track histories; needed whenever the
+    // tracks were replaced or edited outside of map(). New ids continue after
+    // the largest one in use.
+    void invalidateTrackCaches();
+
+    // pose of the track at frame, looked up in the archive if it is no longer
+    // in memory; nullptr if there is none
+    std::shared_ptr<FishPose> getPose(size_t track, size_t frame);
+    // puts all archived poses back into the tracks, e.g. before saving. The
+    // next map() archives them again, archiveRestoredPoses() right away.
+    void restoreArchivedPoses();
+    void archiveRestoredPoses();
+
+    // state right after map() of frame
+    void saveState(size_t frame, State &state) const;
+    // Goes back to just before frame, so map() continues there: tracks
+    // promoted at frame or later are removed, the others keep their poses up
+    // to frame - 1. Candidates are dropped. Ids are not reused, the journal
+    // records a rollback.
+    void rewind(size_t frame);
+    // rewind() that takes over the candidates of a state saved before frame
+    // if at most framesTillPromotion frames lie in between; they carry on
+    // with unknown positions up to frame - 1
+    void restoreState(const State &state, size_t frame);
+
+    // pose allocations made by the last map() call; live is the total afterwards
+    PosePool::Counters allocationsLastFrame() const;
 
 private:
+    // where an object is expected in the frame being mapped
+    struct Prediction {
+        cv::RotatedRect position;
+        float           angle;
+        // largest distance of a contour that may still belong to the object
+        float           gate;
+    };
+
     std::vector<BioTracker::Core::TrackedObject> &m_trackedObjects;
-    std::vector<BioTracker::Core::TrackedObject> _fishCandidates;
+    CandidateStore _fishCandidates;
+    std::vector<CandidateStore::Handle> _promotions;
 
     size_t _numberOfObjects;
     size_t _framesTillPromotion;
     size_t _lastId;
+    // colours of new candidates
+    cv::RNG _rng;
+
+    // indices of the tracks with a pose at _activeFrame - 1, kept up to date by
+    // map() so per frame work does not grow with lost tracks or history
+    std::vector<size_t> _activeTracks;
+    std::vector<size_t> _candidateView;
+    size_t              _activeFrame;
+    size_t              _activeTrackCount;
+    bool                _activeValid;
+
+    PosePool::Counters  _allocationsLastFrame;
+
+    // motion state per track index, brought up to date lazily
+    std::vector<MotionModel> _motion;
+    std::vector<Prediction>  _predictions;
+    // recent poses per candidate slot, appended to by map()
+    std::vector<TrackStatistics> _candidateStatistics;
+
+    PoseRetention       _retention;
+    // first frame still in memory per track index and candidate slot
+    std::vector<size_t> _trackRetainedFrom;
+    std::vector<size_t> _candidateRetainedFrom;
+    // every track may hold its whole history again, not just the active ones
+    bool                _restoredPoses;
+
+    PoseJournal        *_journal;
+
+    std::unique_ptr<AssociationSolver> _solver;
+    std::vector<AssociationEdge>       _edges;
+    std::vector<int>                   _assignment;
+    // contour centers of the current map() call
+    SpatialGrid                        _contourGrid;
+    std::vector<char>                  _contourAssigned;
+    std::vector<size_t>                _nearbyContours;
+    ContourBatch                       _contourBatch;
+    ContourBatch                       _nearbyBatch;
+    std::vector<float>                 _probabilities;
+    std::vector<float>                 _distances;
+
+    // adds an unknown position at frame to every candidate with a pose at
+    // frame - 1
+    void coastCandidates(size_t frame);
+
+    // rescans the tracks unless the view follows directly from the last map()
+    void updateActiveTracks(size_t frame);
+    // applies the retention window to every track after a restore, including
+    // those that have ended and which map() otherwise no longer visits
+    void retainAllTracks(size_t frame);
 
+    static MotionNoise motionNoise();
+    // the motion model of a track with a pose at frame - 1, rebuilt from the
+    // last poses if it does not end there
+    MotionModel &motionModel(size_t track, size_t frame);
 
-    std::tuple<size_t, std::shared_ptr<FishPose>> mergeContoursToFishes(size_t fishIndex, size_t frame,
-                                                                        std::vector<BioTracker::Core::TrackedObject> &fishes,
-                                                                        std::vector<cv::RotatedRect> &contourEllipses,
-																		std::vector<size_t> alreadyTestedIndizies);
+    // fills _predictions for the active tracks from their motion models
+    void predictTracks(size_t frame);
+    // fills _predictions for the candidates in _candidateView
+    void predictCandidates(size_t frame);
 
-    std::tuple<int , float> getNearestIndexFromFishPoses(FishPose &fishPose,
-                                                         const std::vector<cv::RotatedRect> &fishPoses);
+    // contour index for each entry of _predictions, -1 if none. Only contours
+    // not assigned yet are considered; assigned ones get marked. The result is
+    // valid until the next call.
+    const std::vector<int> &associate(const std::vector<cv::RotatedRect> &contourEllipses);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "MappingPipeline.h"
+
+MappingPipeline::MappingPipeline(Stage stage, size_t capacity)
+    : _stage(stage)
+    , _capacity(std::max<size_t>(capacity, 1))
+    , _busy(false)
+    , _stop(false)
+{}
+
+MappingPipeline::~MappingPipeline() {
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        _changed.wait(lock, [this] { return _queue.empty() && !_busy; });
+        _stop = true;
+    }
+    _changed.notify_all();
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
+
+void MappingPipeline::submit(Job job) {
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        if (!_worker.joinable()) {
+            _worker = std::thread(&MappingPipeline::run, this);
+        }
+        _changed.wait(lock, [this] { return _queue.size() < _capacity; });
+        rethrow();
+        _queue.push_back(std::move(job));
+    }
+    _changed.notify_all();
+}
+
+void MappingPipeline::drain() {
+    std::unique_lock<std::mutex> lock(_lock);
+    _changed.wait(lock, [this] { return _queue.empty() && !_busy; });
+    rethrow();
+}
+
+void MappingPipeline::clear() {
+    std::unique_lock<std::mutex> lock(_lock);
+    _queue.clear();
+    _changed.notify_all();
+    _changed.wait(lock, [this] { return !_busy; });
+    _error = nullptr;
+}
+
+// ================ P R I V A T E ===================
+
+void MappingPipeline::run() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _changed.wait(lock, [this] { return _stop || !_queue.empty(); });
+            if (_queue.empty()) {
+                return;
+            }
+            job = std::move(_queue.front());
+            _queue.pop_front();
+            _busy = true;
+        }
+        _changed.notify_all();
+
+        // an exception escaping the worker would terminate the process
+        std::exception_ptr error;
+        try {
+            _stage(job);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            if (error) {
+                // the queued frames build on the one that failed
+                _queue.clear();
+                _error = std::move(error);
+            }
+            _busy = false;
+        }
+        _changed.notify_all();
+    }
+}
+
+void MappingPipeline::rethrow() {
+    if (_error) {
+        std::exception_ptr error = std::move(_error);
+        _error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef MAPPING_PIPELINE_H
+#define MAPPING_PIPELINE_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#include "TrackerParameters.h"
+
+// Runs the association stage on its own thread, fed through a bounded FIFO,
+// so segmentation of frame N + 1 overlaps with mapping of frame N. Jobs are
+// consumed strictly in submission order by a single worker, which keeps the
+// tracking results deterministic. Results therefore lag submit() by up to
+// capacity frames until drain(). An exception thrown by the stage drops the
+// queued jobs and is rethrown on the caller's thread by the next submit() or
+// drain().
+class MappingPipeline {
+public:
+    struct Job {
+        size_t                          frame;
+        std::vector<cv::RotatedRect>    ellipses;
+        TrackerParameters               parameters;
+    };
+    typedef std::function<void(Job &)> Stage;
+
+    MappingPipeline(Stage stage, size_t capacity = 2);
+    ~MappingPipeline();
+
+    // blocks while the queue is full
+    void submit(Job job);
+
+    // waits until every submitted job has been mapped
+    void drain();
+
+    // drops all queued jobs and a pending error and waits for the running job
+    // to finish
+    void clear();
+
+private:
+    void run();
+    // rethrows and forgets the error of a failed job, _lock has to be held
+    void rethrow();
+
+    Stage                       _stage;
+    const size_t                _capacity;
+
+    std::mutex                  _lock;
+    std::condition_variable     _changed;
+    std::deque<Job>             _queue;
+    bool                        _busy;
+    bool                        _stop;
+    std::exception_ptr          _error;
+    std::thread                 _worker;
+};
+
+#endif
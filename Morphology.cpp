@@ -0,0 +1,131 @@
+#include "Morphology.h"
+
+#include <algorithm>
+
+namespace {
+
+struct MinOp {
+    static uchar identity() { return 255; }
+    static uchar apply(uchar a, uchar b) { return std::min(a, b); }
+};
+
+struct MaxOp {
+    static uchar identity() { return 0; }
+    static uchar apply(uchar a, uchar b) { return std::max(a, b); }
+};
+
+// padded length, rounded up to whole blocks of the window size
+int blockLength(int n, int radius) {
+    const int window = 2 * radius + 1;
+    return (n + 2 * radius + window - 1) / window * window;
+}
+
+}
+
+void Morphology::apply(cv::Mat &image, size_t erosions, size_t dilations) {
+    erode(image, static_cast<int>(erosions));
+    dilate(image, static_cast<int>(dilations));
+}
+
+void Morphology::erode(cv::Mat &image, int radius) {
+    filter<MinOp>(image, radius);
+}
+
+void Morphology::dilate(cv::Mat &image, int radius) {
+    filter<MaxOp>(image, radius);
+}
+
+// ================ P R I V A T E ===================
+
+template <class Op>
+void Morphology::filter(cv::Mat &image, int radius) {
+    CV_Assert(image.type() == CV_8UC1);
+    if (radius <= 0 || image.empty()) {
+        return;
+    }
+    filterRows<Op>(image, radius);
+    filterColumns<Op>(image, radius);
+}
+
+// Along each row: with the row padded by radius identity values on both sides
+// and cut into blocks of w = 2r+1, every window [x, x+w) spans at most two
+// blocks, so its result is suffix(x) op prefix(x+w-1).
+template <class Op>
+void Morphology::filterRows(cv::Mat &image, int radius) {
+    const int window = 2 * radius + 1;
+    const int length = blockLength(image.cols, radius);
+    _forward.resize(static_cast<size_t>(length));
+    _backward.resize(static_cast<size_t>(length));
+    uchar *forward = _forward.data();
+    uchar *backward = _backward.data();
+
+    for (int y = 0; y < image.rows; y++) {
+        uchar *row = image.ptr<uchar>(y);
+        auto at = [&](int i) -> uchar {
+            return i >= radius && i < radius + image.cols ? row[i - radius] : Op::identity();
+        };
+        for (int begin = 0; begin < length; begin += window) {
+            const int end = begin + window;
+            forward[begin] = at(begin);
+            for (int i = begin + 1; i < end; i++) {
+                forward[i] = Op::apply(forward[i - 1], at(i));
+            }
+            backward[end - 1] = at(end - 1);
+            for (int i = end - 2; i >= begin; i--) {
+                backward[i] = Op::apply(backward[i + 1], at(i));
+            }
+        }
+        for (int x = 0; x < image.cols; x++) {
+            row[x] = Op::apply(backward[x], forward[x + window - 1]);
+        }
+    }
+}
+
+// Same recurrence down the columns, with whole rows as elements so the inner
+// loops run over contiguous memory.
+template <class Op>
+void Morphology::filterColumns(cv::Mat &image, int radius) {
+    const int window = 2 * radius + 1;
+    const int length = blockLength(image.rows, radius);
+    const size_t cols = static_cast<size_t>(image.cols);
+    _forward.resize(static_cast<size_t>(length) * cols);
+    _backward.resize(static_cast<size_t>(length) * cols);
+    _padding.assign(cols, Op::identity());
+
+    auto at = [&](int i) -> const uchar * {
+        return i >= radius && i < radius + image.rows ? image.ptr<uchar>(i - radius) : _padding.data();
+    };
+    auto forward = [&](int i) { return _forward.data() + static_cast<size_t>(i) * cols; };
+    auto backward = [&](int i) { return _backward.data() + static_cast<size_t>(i) * cols; };
+
+    for (int begin = 0; begin < length; begin += window) {
+        const int end = begin + window;
+        std::copy(at(begin), at(begin) + cols, forward(begin));
+        for (int i = begin + 1; i < end; i++) {
+            const uchar *previous = forward(i - 1);
+            const uchar *current = at(i);
+            uchar *out = forward(i);
+            for (size_t x = 0; x < cols; x++) {
+                out[x] = Op::apply(previous[x], current[x]);
+            }
+        }
+        std::copy(at(end - 1), at(end - 1) + cols, backward(end - 1));
+        for (int i = end - 2; i >= begin; i--) {
+            const uchar *next = backward(i + 1);
+            const uchar *current = at(i);
+            uchar *out = backward(i);
+            for (size_t x = 0; x < cols; x++) {
+                out[x] = Op::apply(next[x], current[x]);
+            }
+        }
+    }
+
+    for (int y = 0; y < image.rows; y++) {
+        const uchar *suffix = backward(y);
+        const uchar *prefix = forward(y + window - 1);
+        uchar *row = image.ptr<uchar>(y);
+        for (size_t x = 0; x < cols; x++) {
+            row[x] = Op::apply(suffix[x], prefix[x]);
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include <opencv2/opencv.hpp>
+
+// Repeated 3x3 erosions and dilations in a fixed number of passes.
+// k iterations of a 3x3 erosion (dilation) with pixels outside the image
+// ignored, as cv::erode/cv::dilate do with their default border, equal one
+// erosion (dilation) with a (2k+1)x(2k+1) square clipped to the image. The
+// square is separable and every 1D pass uses the van Herk/Gil-Werman running
+// min/max, so the cost per pixel does not depend on k and the result is
+// bit-exact with the iterated OpenCV calls.
+class Morphology {
+public:
+    // erodes image (CV_8UC1) erosions times and then dilates it dilations times, in place
+    void apply(cv::Mat &image, size_t erosions, size_t dilations);
+
+    void erode(cv::Mat &image, int radius);
+    void dilate(cv::Mat &image, int radius);
+
+private:
+    template <class Op>
+    void filter(cv::Mat &image, int radius);
+    template <class Op>
+    void filterRows(cv::Mat &image, int radius);
+    template <class Op>
+    void filterColumns(cv::Mat &image, int radius);
+
+    // prefix (_forward) and suffix (_backward) results within blocks of 2r+1
+    std::vector<uchar> _forward;
+    std::vector<uchar> _backward;
+    std::vector<uchar> _padding;
+};
+
+#endif
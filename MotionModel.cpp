@@ -0,0 +1,79 @@
+#include "MotionModel.h"
+
+#include <cmath>
+#include <limits>
+
+MotionModel::MotionModel()
+    : _position(0.0f, 0.0f)
+    , _velocity(0.0f, 0.0f)
+    , _positionVariance(0.0f)
+    , _covariance(0.0f)
+    , _velocityVariance(0.0f)
+    , _frame(std::numeric_limits<size_t>::max())
+{}
+
+void MotionModel::initialize(const cv::Point2f &position, size_t frame, const MotionNoise &noise, float speedVariance) {
+    _position = position;
+    _velocity = cv::Point2f(0.0f, 0.0f);
+    _positionVariance = noise.measurement;
+    _covariance = 0.0f;
+    _velocityVariance = speedVariance;
+    _frame = frame;
+}
+
+void MotionModel::update(const cv::Point2f &measurement, const MotionNoise &noise) {
+    predict(noise);
+    const float innovation = _positionVariance + noise.measurement;
+    const float positionGain = _positionVariance / innovation;
+    const float velocityGain = _covariance / innovation;
+    const cv::Point2f residual = measurement - _position;
+    _position += positionGain * residual;
+    _velocity += velocityGain * residual;
+    _velocityVariance -= velocityGain * _covariance;
+    _covariance *= 1.0f - positionGain;
+    _positionVariance *= 1.0f - positionGain;
+}
+
+void MotionModel::coast(const MotionNoise &noise) {
+    predict(noise);
+}
+
+size_t MotionModel::frame() const {
+    return _frame;
+}
+
+cv::Point2f MotionModel::position() const {
+    return _position;
+}
+
+cv::Point2f MotionModel::velocity() const {
+    return _velocity;
+}
+
+float MotionModel::speed() const {
+    return std::sqrt(_velocity.x * _velocity.x + _velocity.y * _velocity.y);
+}
+
+float MotionModel::heading() const {
+    return std::atan2(-_velocity.y, _velocity.x);
+}
+
+cv::Point2f MotionModel::predictedPosition() const {
+    return _position + _velocity;
+}
+
+float MotionModel::innovationVariance(const MotionNoise &noise) const {
+    return _positionVariance + 2.0f * _covariance + _velocityVariance + 0.25f * noise.acceleration + noise.measurement;
+}
+
+// ================ P R I V A T E ===================
+
+void MotionModel::predict(const MotionNoise &noise) {
+    // x' = x + v, v' = v, with an acceleration a held over the frame adding
+    // a/2 to the position and a to the velocity
+    _position += _velocity;
+    _positionVariance += 2.0f * _covariance + _velocityVariance + 0.25f * noise.acceleration;
+    _covariance += _velocityVariance + 0.5f * noise.acceleration;
+    _velocityVariance += noise.acceleration;
+    _frame++;
+}
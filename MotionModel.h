@@ -0,0 +1,54 @@
+#ifndef MOTION_MODEL_H
+#define MOTION_MODEL_H
+
+#include <opencv2/opencv.hpp>
+
+// Variances of the constant velocity model, in px² per frame.
+struct MotionNoise {
+    // random acceleration between two frames
+    float acceleration;
+    // jitter of a measured contour center
+    float measurement;
+};
+
+// Constant velocity Kalman filter over the center of one track. With the
+// same noise on both axes the x and y filters share one 2x2 covariance, so
+// predicting and correcting are a handful of flops per frame.
+class MotionModel {
+public:
+    MotionModel();
+
+    // starts over at a measured position with unknown velocity
+    void initialize(const cv::Point2f &position, size_t frame, const MotionNoise &noise, float speedVariance);
+    // advances by one frame and corrects with the center measured there
+    void update(const cv::Point2f &measurement, const MotionNoise &noise);
+    // advances by one frame without a measurement
+    void coast(const MotionNoise &noise);
+
+    // frame the state refers to, size_t max before initialize()
+    size_t frame() const;
+
+    cv::Point2f position() const;
+    cv::Point2f velocity() const;
+    float speed() const;
+    // radians, with y pointing up like TrackedFish::estimateOrientationRad
+    float heading() const;
+
+    // center expected in the next frame
+    cv::Point2f predictedPosition() const;
+    // variance of the next measurement around predictedPosition(), per axis
+    float innovationVariance(const MotionNoise &noise) const;
+
+private:
+    void predict(const MotionNoise &noise);
+
+    cv::Point2f _position;
+    cv::Point2f _velocity;
+    // covariance of (position, velocity), identical for both axes
+    float       _positionVariance;
+    float       _covariance;
+    float       _velocityVariance;
+    size_t      _frame;
+};
+
+#endif
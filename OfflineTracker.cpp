@@ -0,0 +1,251 @@
+#include "OfflineTracker.h"
+
+#include "Association.h"
+#include "BackgroundModel.h"
+#include "FishCandidate.h"
+#include "FishPose.h"
+#include "Mapper.h"
+#include "PosePool.h"
+#include "SegmentationEngine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+using namespace BioTracker::Core;
+
+const size_t OfflineTracker::DefaultOverlap;
+
+OfflineTracker::OfflineTracker(const TrackerParameters &parameters)
+    : _parameters(parameters)
+    , _chunkCount(0)
+    , _overlap(DefaultOverlap)
+{}
+
+void OfflineTracker::setChunkCount(size_t chunkCount) {
+    _chunkCount = chunkCount;
+}
+
+void OfflineTracker::setOverlap(size_t overlap) {
+    _overlap = overlap;
+}
+
+bool OfflineTracker::run(const std::string &path, std::vector<TrackedObject> &tracks, size_t first, size_t end) {
+    tracks.clear();
+    if (end == 0) {
+        cv::VideoCapture capture(path);
+        if (!capture.isOpened()) {
+            return false;
+        }
+        end = static_cast<size_t>(std::max(capture.get(CV_CAP_PROP_FRAME_COUNT), 0.0));
+    }
+    if (end <= first) {
+        return false;
+    }
+
+    // the pose model is global; every chunk maps with the same speed
+    const float averageSpeedPx = _parameters.averageSpeedPx;
+    FishPose::_averageSpeed = averageSpeedPx;
+    FishPose::_averageSpeedSigma = std::sqrt(-(averageSpeedPx*averageSpeedPx/2) * (1/std::log(0.33f)));
+
+    const size_t threads = SegmentationEngine::resolveThreadCount(0);
+    const size_t overlap = std::max(_overlap, 2 * _parameters.framesTillPromotion);
+    // chunks much shorter than the overlap would spend most of their time on it
+    const size_t frames = end - first;
+    const size_t chunkCount = std::max<size_t>(1, std::min(_chunkCount > 0 ? _chunkCount : threads,
+                                                           frames / std::max<size_t>(overlap, 1)));
+    std::vector<Chunk> chunks(chunkCount);
+    for (size_t k = 0; k < chunkCount; k++) {
+        Chunk &chunk = chunks[k];
+        chunk.begin = first + frames * k / chunkCount;
+        chunk.end = first + frames * (k + 1) / chunkCount;
+        chunk.start = k == 0 ? chunk.begin : std::max(first, chunk.begin - std::min(chunk.begin, overlap));
+        chunk.read = false;
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < std::min(threads, chunkCount); t++) {
+        workers.emplace_back([&] {
+            for (size_t k = next++; k < chunks.size(); k = next++) {
+                trackChunk(path, chunks[k]);
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    if (!chunks.front().read) {
+        return false;
+    }
+    size_t nextId = 1;
+    for (Chunk &chunk : chunks) {
+        // past the real end of a video with an overestimated frame count
+        if (chunk.read) {
+            stitch(chunk, tracks, nextId);
+        }
+    }
+    return true;
+}
+
+// ================ P R I V A T E ===================
+
+void OfflineTracker::trackChunk(const std::string &path, Chunk &chunk) const {
+    cv::VideoCapture capture(path);
+    if (!capture.isOpened()) {
+        return;
+    }
+    if (!seek(capture, path, chunk.start)) {
+        return;
+    }
+
+    const TrackerParameters &parameters = _parameters;
+    BackgroundModel background;
+    SegmentationEngine segmentation;
+    // the chunks already keep every core busy
+    segmentation.setThreadCount(1);
+    Mapper mapper(chunk.tracks, parameters.numberOfObjects, parameters.framesTillPromotion, parameters.candidateCapacity);
+    mapper.setRetentionWindow(parameters.retentionWindow);
+    mapper.setArchiveSpill(parameters.spillArchive);
+
+    cv::Mat frame;
+    cv::Mat frameGRAY;
+    cv::Mat foreground;
+    std::vector<cv::RotatedRect> ellipses;
+    for (size_t frameNumber = chunk.start; frameNumber < chunk.end; frameNumber++) {
+        if (!capture.read(frame)) {
+            // the frame count of some containers is only an estimate
+            break;
+        }
+        cv::cvtColor(frame, frameGRAY, CV_BGR2GRAY);
+        background.update(frameGRAY, parameters.backgroundWeight);
+        segmentation.segment(background.view(), frameGRAY, parameters, foreground, ellipses);
+        mapper.map(ellipses, frameNumber);
+        chunk.read = true;
+    }
+    mapper.restoreArchivedPoses();
+}
+
+bool OfflineTracker::seek(cv::VideoCapture &capture, const std::string &path, size_t frame) {
+    if (frame == 0) {
+        return true;
+    }
+    if (capture.set(CV_CAP_PROP_POS_FRAMES, static_cast<double>(frame)) &&
+        std::llround(capture.get(CV_CAP_PROP_POS_FRAMES)) == static_cast<long long>(frame)) {
+        return true;
+    }
+    // grab() skips the conversion into an image that read() does
+    if (!capture.open(path)) {
+        return false;
+    }
+    for (size_t skipped = 0; skipped < frame; skipped++) {
+        if (!capture.grab()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void OfflineTracker::stitch(Chunk &chunk, std::vector<TrackedObject> &tracks, size_t &nextId) const {
+    // the second half of the overlap, once the chunk's own tracks are promoted
+    const size_t windowBegin = chunk.start + (chunk.begin - chunk.start) / 2;
+    const size_t windowEnd = chunk.begin;
+
+    std::vector<AssociationEdge> edges;
+    std::vector<int> assignment;
+    if (windowBegin < windowEnd) {
+        // a track the chunk continues has to agree on most of the window
+        const float minimumAgreement = 0.5f;
+        for (size_t row = 0; row < chunk.tracks.size(); row++) {
+            for (size_t column = 0; column < tracks.size(); column++) {
+                const float share = agreement(tracks[column], chunk.tracks[row], windowBegin, windowEnd);
+                if (share >= minimumAgreement) {
+                    edges.push_back({row, column, 1.0 - share});
+                }
+            }
+        }
+    }
+    HungarianSolver().solve(chunk.tracks.size(), tracks.size(), edges, 1.0, assignment);
+
+    // the earlier chunks' poses stand up to chunk.begin, this one's from there
+    // on; new tracks are numbered in order of appearance like in a serial run
+    for (size_t row = 0; row < chunk.tracks.size(); row++) {
+        TrackedObject &later = chunk.tracks[row];
+        const int column = assignment.empty() ? -1 : assignment[row];
+        TrackedObject *track;
+        if (column >= 0) {
+            track = &tracks[static_cast<size_t>(column)];
+        } else {
+            TrackedObject object(nextId);
+            tracks.push_back(std::move(object));
+            track = &tracks.back();
+        }
+        bool added = false;
+        const boost::optional<size_t> lastFrame = later.getLastFrameNumber();
+        const size_t end = lastFrame ? std::min(chunk.end, lastFrame.get() + 1) : chunk.begin;
+        // a new track promoted in the chunk's own frames brings its candidate
+        // poses from before them along, as it does in a serial run
+        size_t begin = chunk.begin;
+        if (column < 0) {
+            size_t promoted = chunk.start;
+            while (promoted < end && (!later.hasValuesAtFrame(promoted) ||
+                                      std::dynamic_pointer_cast<FishCandidate>(later.get<FishPose>(promoted)))) {
+                promoted++;
+            }
+            if (promoted >= chunk.begin && promoted < end) {
+                begin = chunk.start;
+            }
+        }
+        // a continued track keeps its colour
+        const std::shared_ptr<FishPose> previous = column >= 0 && windowEnd > 0 && track->hasValuesAtFrame(windowEnd - 1)
+                                                   ? track->get<FishPose>(windowEnd - 1) : nullptr;
+        for (size_t frame = begin; frame < end; frame++) {
+            if (!later.hasValuesAtFrame(frame)) {
+                continue;
+            }
+            std::shared_ptr<FishPose> pose = later.get<FishPose>(frame);
+            if (previous) {
+                const std::shared_ptr<FishCandidate> candidate = std::dynamic_pointer_cast<FishCandidate>(pose);
+                pose = candidate ? allocatePose<FishCandidate>(*candidate) : allocatePose<FishPose>(*pose);
+                pose->set_associated_color(previous->associated_color());
+            }
+            track->add(frame, pose);
+            added = true;
+        }
+        if (column < 0) {
+            if (added) {
+                nextId++;
+            } else {
+                // only lived in the overlap, which the earlier chunk covers
+                tracks.pop_back();
+            }
+        }
+    }
+    chunk.tracks.clear();
+}
+
+float OfflineTracker::agreement(const TrackedObject &earlier, const TrackedObject &later, size_t begin, size_t end) {
+    // both chunks segment the same frames, so agreeing poses are nearly identical
+    const float tolerance = FishPose::_averageSpeed / 4;
+    size_t frames = 0;
+    size_t agreeing = 0;
+    for (size_t frame = begin; frame < end; frame++) {
+        if (!earlier.hasValuesAtFrame(frame)) {
+            continue;
+        }
+        frames++;
+        if (!later.hasValuesAtFrame(frame)) {
+            continue;
+        }
+        const cv::Point2f a = earlier.get<FishPose>(frame)->last_known_position().center;
+        const cv::Point2f b = later.get<FishPose>(frame)->last_known_position().center;
+        if (std::hypot(a.x - b.x, a.y - b.y) <= tolerance) {
+            agreeing++;
+        }
+    }
+    return frames > 0 ? static_cast<float>(agreeing) / frames : 0.0f;
+}
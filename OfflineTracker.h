@@ -0,0 +1,64 @@
+#ifndef OFFLINE_TRACKER_H
+#define OFFLINE_TRACKER_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <biotracker/serialization/TrackedObject.h>
+
+#include "TrackerParameters.h"
+
+// Tracks a video file without the GUI, split into chunks that are tracked
+// on separate threads. Every chunk but the first starts overlap frames
+// early; those frames warm up its background and give its tracks time to be
+// promoted before the chunk's own frames begin. Stitching then continues each
+// track of the previous chunks with the chunk's track that agrees with it on
+// the poses of the overlap, and numbers the remaining ones as new tracks.
+class OfflineTracker {
+public:
+    static const size_t DefaultOverlap = 250;
+
+    explicit OfflineTracker(const TrackerParameters &parameters);
+
+    // 0 = one per cpu
+    void setChunkCount(size_t chunkCount);
+    // frames tracked twice at each seam, at least twice framesTillPromotion
+    void setOverlap(size_t overlap);
+
+    // Tracks frames [first, end) of the video, all from first if end is 0.
+    // Returns false if the video cannot be read.
+    bool run(const std::string &path, std::vector<BioTracker::Core::TrackedObject> &tracks,
+             size_t first = 0, size_t end = 0);
+
+private:
+    struct Chunk {
+        // frames the chunk is responsible for, [begin, end)
+        size_t  begin;
+        size_t  end;
+        // first frame tracked, begin minus the overlap
+        size_t  start;
+        bool    read;
+        std::vector<BioTracker::Core::TrackedObject> tracks;
+    };
+
+    void trackChunk(const std::string &path, Chunk &chunk) const;
+    // Positions capture at frame. Seeking by frame number lands on a nearby
+    // keyframe with some codecs and containers, so the position is checked
+    // and, if it is off, the video is read again from the start up to frame.
+    // Returns false if the video ends before frame.
+    static bool seek(cv::VideoCapture &capture, const std::string &path, size_t frame);
+    // adds the tracks of chunk to tracks, which hold all earlier chunks
+    void stitch(Chunk &chunk, std::vector<BioTracker::Core::TrackedObject> &tracks, size_t &nextId) const;
+    // share of the frames in [begin, end) with a pose of earlier where later
+    // has a pose close to it
+    static float agreement(const BioTracker::Core::TrackedObject &earlier, const BioTracker::Core::TrackedObject &later,
+                           size_t begin, size_t end);
+
+    TrackerParameters   _parameters;
+    size_t              _chunkCount;
+    size_t              _overlap;
+};
+
+#endif
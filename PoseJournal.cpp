@@ -0,0 +1,504 @@
+#include "PoseJournal.h"
+
+#include "FishCandidate.h"
+#include "TrajectoryFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace BioTracker::Core;
+
+const size_t PoseJournal::DefaultCheckpointInterval;
+const std::chrono::milliseconds PoseJournal::SyncInterval(1000);
+
+PoseJournal::PoseJournal()
+    : _checkpointInterval(DefaultCheckpointInterval)
+    , _stop(false)
+    , _segments(0)
+    , _lastFrame(0)
+    , _checkpointFrame(0)
+    , _unsynced(false)
+    , _failed(false)
+{}
+
+PoseJournal::~PoseJournal() {
+    close();
+}
+
+bool PoseJournal::open(const QString &base, std::vector<TrackedObject> &recovered) {
+    close();
+    _base = base;
+    _failed = false;
+    _journal.setFileName(base + ".journal");
+    if (!_journal.open(QIODevice::ReadWrite) || !recover(recovered)) {
+        // leaves the files as they are, a checkpoint now would add to them
+        _journal.close();
+        clearTracks();
+        return false;
+    }
+    start();
+    return true;
+}
+
+void PoseJournal::close() {
+    stop();
+    if (_journal.isOpen()) {
+        checkpoint();
+        _journal.close();
+    }
+    _pending.clear();
+    clearTracks();
+}
+
+bool PoseJournal::isOpen() const {
+    return _journal.isOpen();
+}
+
+bool PoseJournal::failed() const {
+    return _failed;
+}
+
+void PoseJournal::reset() {
+    if (!_journal.isOpen()) {
+        return;
+    }
+    stop();
+    _pending.clear();
+    clearTracks();
+    _lastFrame = 0;
+    _checkpointFrame = 0;
+    // newest first, a failure in between leaves earlier segments only
+    while (_segments > 0) {
+        QFile::remove(segmentPath(--_segments));
+    }
+    _failed = !_journal.resize(0) || !_journal.seek(0) || !sync();
+    start();
+}
+
+void PoseJournal::setCheckpointInterval(size_t frames) {
+    std::lock_guard<std::mutex> lock(_lock);
+    _checkpointInterval = frames;
+}
+
+void PoseJournal::promotion(size_t id, size_t frame) {
+    if (_writer.joinable()) {
+        _pending.push_back(makeRecord(PromotionRecord, id, frame));
+    }
+}
+
+void PoseJournal::pose(size_t id, size_t frame, const FishPose &pose) {
+    if (!_writer.joinable()) {
+        return;
+    }
+    Record record = makeRecord(PoseRecord, id, frame);
+    const cv::RotatedRect position = pose.last_known_position();
+    const cv::Scalar color = pose.associated_color();
+    record.center[0] = position.center.x;
+    record.center[1] = position.center.y;
+    record.size[0] = position.size.width;
+    record.size[1] = position.size.height;
+    record.rectangleAngle = position.angle;
+    record.angle = pose.angle();
+    for (int c = 0; c < 4; c++) {
+        record.color[c] = static_cast<float>(color[c]);
+    }
+    record.age = static_cast<uint32_t>(pose.age_of_last_known_position());
+    if (const FishCandidate *candidate = dynamic_cast<const FishCandidate *>(&pose)) {
+        record.candidate = 1;
+        record.score = candidate->score();
+    }
+    _pending.push_back(record);
+}
+
+void PoseJournal::lost(size_t id, size_t frame) {
+    if (_writer.joinable()) {
+        _pending.push_back(makeRecord(LostRecord, id, frame));
+    }
+}
+
+void PoseJournal::commit(size_t frame) {
+    if (!_writer.joinable()) {
+        _pending.clear();
+        return;
+    }
+    _pending.push_back(makeRecord(FrameRecord, 0, frame));
+    submit();
+}
+
+void PoseJournal::rollback(size_t frame, const std::vector<size_t> &dropped) {
+    if (!_writer.joinable()) {
+        _pending.clear();
+        return;
+    }
+    for (size_t id : dropped) {
+        _pending.push_back(makeRecord(DropRecord, id, frame));
+    }
+    _pending.push_back(makeRecord(RollbackRecord, 0, frame));
+    submit();
+}
+
+bool PoseJournal::flush() {
+    if (!_writer.joinable()) {
+        return !_failed;
+    }
+    // the writer drains the queue before it stops, a due checkpoint follows
+    // once it runs again
+    stop();
+    if (!_failed && _unsynced) {
+        sync();
+    }
+    start();
+    return !_failed;
+}
+
+// ================ P R I V A T E ===================
+
+PoseJournal::Record PoseJournal::makeRecord(RecordType type, size_t id, size_t frame) {
+    static_assert(sizeof(Record) == 80, "journal records are written as they are in memory");
+    Record record;
+    std::memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.id = id;
+    record.frame = frame;
+    return record;
+}
+
+uint32_t PoseJournal::checksum(const Record &record) {
+    // FNV-1a over the record with the checksum field zeroed
+    Record copy = record;
+    copy.checksum = 0;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&copy);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(copy); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void PoseJournal::start() {
+    _stop = false;
+    _unsynced = false;
+    _lastSync = std::chrono::steady_clock::now();
+    _writer = std::thread(&PoseJournal::run, this);
+}
+
+void PoseJournal::stop() {
+    if (!_writer.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _stop = true;
+    }
+    _changed.notify_all();
+    _writer.join();
+}
+
+void PoseJournal::submit() {
+    for (Record &record : _pending) {
+        record.checksum = checksum(record);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _queue.insert(_queue.end(), _pending.begin(), _pending.end());
+    }
+    _changed.notify_all();
+    _pending.clear();
+}
+
+void PoseJournal::run() {
+    std::vector<Record> batch;
+    for (;;) {
+        bool stopping;
+        size_t checkpointInterval;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _changed.wait_for(lock, SyncInterval, [this] { return _stop || !_queue.empty(); });
+            batch.swap(_queue);
+            stopping = _stop;
+            checkpointInterval = _checkpointInterval;
+        }
+
+        if (!batch.empty()) {
+            // records after a failed write would only follow a torn one,
+            // recovery stops before them anyway
+            if (!_failed) {
+                const qint64 bytes = static_cast<qint64>(batch.size() * sizeof(Record));
+                if (_journal.write(reinterpret_cast<const char *>(batch.data()), bytes) != bytes) {
+                    _failed = true;
+                }
+                _unsynced = true;
+            }
+            for (const Record &record : batch) {
+                apply(record);
+            }
+            batch.clear();
+        }
+
+        // stopping syncs in close(), through the checkpoint
+        if (stopping) {
+            return;
+        }
+        if (checkpointInterval > 0 && _lastFrame >= _checkpointFrame + checkpointInterval) {
+            if (!checkpoint()) {
+                // tried again an interval later, not on every batch
+                _checkpointFrame = _lastFrame;
+            }
+        } else if (!_failed && _unsynced && std::chrono::steady_clock::now() - _lastSync >= SyncInterval) {
+            sync();
+        }
+    }
+}
+
+void PoseJournal::apply(const Record &record) {
+    switch (record.type) {
+    case PoseRecord: {
+        Trajectory &trajectory = track(static_cast<size_t>(record.id));
+        // a track starts with its first pose; a replay never reaches before it
+        if (!trajectory.empty() && record.frame < trajectory.firstFrame()) {
+            break;
+        }
+        FishPose pose(record.age, cv::RotatedRect(cv::Point2f(record.center[0], record.center[1]),
+                                                  cv::Size2f(record.size[0], record.size[1]),
+                                                  record.rectangleAngle));
+        pose.setAngle(record.angle);
+        pose.set_associated_color(cv::Scalar(record.color[0], record.color[1], record.color[2], record.color[3]));
+        if (record.candidate) {
+            trajectory.add(static_cast<size_t>(record.frame), FishCandidate(pose, record.score));
+        } else {
+            trajectory.add(static_cast<size_t>(record.frame), pose);
+        }
+        break;
+    }
+    case PromotionRecord:
+        track(static_cast<size_t>(record.id));
+        break;
+    case FrameRecord:
+        _lastFrame = std::max(_lastFrame, static_cast<size_t>(record.frame));
+        break;
+    case DropRecord:
+        _dropped.push_back(static_cast<size_t>(record.id));
+        break;
+    case RollbackRecord:
+        rollbackTracks(static_cast<size_t>(record.frame));
+        break;
+    default:
+        // lost tracks simply get no more poses, the mirror needs nothing
+        break;
+    }
+}
+
+Trajectory &PoseJournal::track(size_t id) {
+    const auto found = _trackIndex.find(id);
+    if (found != _trackIndex.end()) {
+        return _trajectories[found->second];
+    }
+    _trackIndex.emplace(id, _trajectories.size());
+    _ids.push_back(id);
+    _trajectories.emplace_back();
+    return _trajectories.back();
+}
+
+void PoseJournal::clearTracks() {
+    _ids.clear();
+    _trajectories.clear();
+    _trackIndex.clear();
+    _dropped.clear();
+}
+
+bool PoseJournal::dropped(size_t id) const {
+    return std::find(_dropped.begin(), _dropped.end(), id) != _dropped.end();
+}
+
+void PoseJournal::rollbackTracks(size_t frame) {
+    size_t kept = 0;
+    _trackIndex.clear();
+    for (size_t k = 0; k < _ids.size(); k++) {
+        if (dropped(_ids[k])) {
+            continue;
+        }
+        _trajectories[k].truncate(frame);
+        _ids[kept] = _ids[k];
+        std::swap(_trajectories[kept], _trajectories[k]);
+        _trackIndex.emplace(_ids[kept], kept);
+        kept++;
+    }
+    _ids.resize(kept);
+    _trajectories.resize(kept);
+
+    // the segments only hold frames up to the last checkpoint
+    if (frame <= _checkpointFrame && !rollbackSegments(frame)) {
+        _failed = true;
+    }
+    _lastFrame = std::min(_lastFrame, frame > 0 ? frame - 1 : 0);
+    _checkpointFrame = std::min(_checkpointFrame, _lastFrame);
+    _dropped.clear();
+}
+
+bool PoseJournal::rollbackSegments(size_t frame) {
+    // the rollback record has to be on disk before the segments lose what it
+    // takes back, recovery applies it again
+    if (!sync()) {
+        return false;
+    }
+    std::vector<size_t> ids;
+    std::vector<Trajectory> trajectories;
+    for (size_t n = 0; n < _segments; n++) {
+        ids.clear();
+        trajectories.clear();
+        {
+            TrajectoryFile segment;
+            if (!segment.open(segmentPath(n))) {
+                return false;
+            }
+            bool changed = false;
+            for (size_t k = 0; k < segment.trackCount() && !changed; k++) {
+                changed = dropped(segment.trackId(k)) || segment.endFrame(k) > frame;
+            }
+            if (!changed) {
+                continue;
+            }
+            for (size_t k = 0; k < segment.trackCount(); k++) {
+                if (dropped(segment.trackId(k))) {
+                    continue;
+                }
+                trajectories.emplace_back();
+                if (!segment.trajectory(k, trajectories.back())) {
+                    return false;
+                }
+                trajectories.back().truncate(frame);
+                ids.push_back(segment.trackId(k));
+            }
+        }
+        if (!TrajectoryFile::write(segmentPath(n), ids, trajectories)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PoseJournal::checkpoint() {
+    // the journal may only start over once a segment holds all of it
+    if (!_ids.empty()) {
+        if (!TrajectoryFile::write(segmentPath(_segments), _ids, _trajectories)) {
+            _failed = true;
+            return false;
+        }
+        _segments++;
+    }
+    if (!_journal.resize(0) || !_journal.seek(0) || !sync()) {
+        _failed = true;
+        return false;
+    }
+    clearTracks();
+    _checkpointFrame = _lastFrame;
+    // segments and journal hold everything again
+    _failed = false;
+    return true;
+}
+
+bool PoseJournal::sync() {
+    _lastSync = std::chrono::steady_clock::now();
+    if (!_journal.flush()) {
+        _failed = true;
+        return false;
+    }
+#ifdef _WIN32
+    const bool synced = _commit(_journal.handle()) == 0;
+#else
+    const bool synced = ::fsync(_journal.handle()) == 0;
+#endif
+    _unsynced = !synced;
+    if (!synced) {
+        _failed = true;
+    }
+    return synced;
+}
+
+QString PoseJournal::segmentPath(size_t segment) const {
+    return _base + ".checkpoint." + QString::number(segment);
+}
+
+bool PoseJournal::recover(std::vector<TrackedObject> &recovered) {
+    clearTracks();
+    _segments = 0;
+    _lastFrame = 0;
+    recovered.clear();
+
+    // tracks are appended where they first turn up, later poses of the same
+    // frame replace earlier ones
+    std::unordered_map<size_t, size_t> objects;
+    auto merge = [&](size_t id, const Trajectory &trajectory) {
+        auto found = objects.find(id);
+        if (found == objects.end()) {
+            found = objects.emplace(id, recovered.size()).first;
+            recovered.emplace_back(id);
+        }
+        TrackedObject &object = recovered[found->second];
+        for (size_t frame = trajectory.firstFrame(); frame < trajectory.endFrame(); frame++) {
+            if (trajectory.hasValuesAtFrame(frame)) {
+                object.add(frame, trajectory.get<FishPose>(frame));
+            }
+        }
+    };
+
+    // the journal tail is replayed before the segments are read, a rollback
+    // in it may still have to cut them
+    for (; QFile::exists(segmentPath(_segments)); _segments++) {
+        TrajectoryFile segment;
+        if (!segment.open(segmentPath(_segments))) {
+            return false;
+        }
+        for (size_t k = 0; k < segment.trackCount(); k++) {
+            if (segment.endFrame(k) > segment.firstFrame(k)) {
+                _lastFrame = std::max(_lastFrame, segment.endFrame(k) - 1);
+            }
+        }
+    }
+    _checkpointFrame = _lastFrame;
+
+    // records count once their frame or rollback is complete; everything
+    // after the last complete one, or after a damaged record, is dropped
+    const QByteArray journal = _journal.readAll();
+    const size_t records = static_cast<size_t>(journal.size()) / sizeof(Record);
+    size_t applied = 0;
+    Record record;
+    for (size_t k = 0; k < records; k++) {
+        std::memcpy(&record, journal.constData() + k * sizeof(Record), sizeof(Record));
+        if (record.checksum != checksum(record) || record.type < PoseRecord || record.type > RollbackRecord) {
+            break;
+        }
+        if (record.type == FrameRecord || record.type == RollbackRecord) {
+            for (size_t j = applied; j <= k; j++) {
+                std::memcpy(&record, journal.constData() + j * sizeof(Record), sizeof(Record));
+                apply(record);
+            }
+            applied = k + 1;
+        }
+    }
+
+    Trajectory trajectory;
+    for (size_t n = 0; n < _segments; n++) {
+        TrajectoryFile segment;
+        if (!segment.open(segmentPath(n))) {
+            return false;
+        }
+        for (size_t k = 0; k < segment.trackCount(); k++) {
+            if (!segment.trajectory(k, trajectory)) {
+                return false;
+            }
+            merge(segment.trackId(k), trajectory);
+        }
+    }
+    for (size_t k = 0; k < _trajectories.size(); k++) {
+        merge(_ids[k], _trajectories[k]);
+    }
+    const qint64 kept = static_cast<qint64>(applied * sizeof(Record));
+    return _journal.resize(kept) && _journal.seek(kept);
+}
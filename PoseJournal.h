@@ -0,0 +1,165 @@
+#ifndef POSE_JOURNAL_H
+#define POSE_JOURNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <QFile>
+#include <QString>
+
+#include <biotracker/serialization/TrackedObject.h>
+
+#include "FishPose.h"
+#include "Trajectory.h"
+
+// Append-only record of the tracking results, written while tracking runs.
+// map() hands over the new poses, promotions and lost tracks of a frame in
+// one batch; a writer thread appends them as fixed size, checksummed records
+// to <base>.journal and syncs the file at most once per SyncInterval.
+// Every checkpointInterval frames the writer moves what the journal holds
+// into a TrajectoryFile segment at <base>.checkpoint.<n>, with a block for
+// each track that got poses since the previous one, and starts the journal
+// over. Each checkpoint only writes the frames since the last, and the
+// writer only keeps those in memory.
+//
+// Going back in the video is journaled as a rollback: the tracks the mapper
+// dropped go and all others are cut before the frame tracking resumes at,
+// in the segments as well, so nothing is wiped and ids are never reused.
+//
+// A failed write, sync or checkpoint is sticky: failed() reports it and the
+// writer stops appending to the journal, which may end in a torn record now.
+// It keeps collecting the tracks and tries a checkpoint again one interval
+// later and on close(); one that succeeds makes the files whole again.
+//
+// open() recovers from the segments in order plus the journal tail up to
+// the last complete frame; a torn write at the end of the journal is cut
+// off. Replaying a record twice has no effect, so a crash between writing a
+// segment and truncating the journal loses nothing either.
+class PoseJournal {
+public:
+    static const size_t DefaultCheckpointInterval = 9000;
+
+    PoseJournal();
+    // writes a final checkpoint
+    ~PoseJournal();
+
+    // Reads back what a previous session left at base into recovered, one
+    // TrackedObject per track in promotion order, and continues journaling
+    // there. Returns false if the files cannot be opened or written.
+    bool open(const QString &base, std::vector<BioTracker::Core::TrackedObject> &recovered);
+    // waits for the writer, checkpoints and closes the files
+    void close();
+    bool isOpen() const;
+    // the files are not crash-safe since a write failed, see above
+    bool failed() const;
+    // drops all journaled tracks and checkpoints, e.g. when tracking starts over
+    void reset();
+
+    // frames between checkpoints; 0 only checkpoints on close()
+    void setCheckpointInterval(size_t frames);
+
+    // Called by the tracking thread, collected until commit(). Nothing is
+    // recorded while the journal is closed.
+    void promotion(size_t id, size_t frame);
+    void pose(size_t id, size_t frame, const FishPose &pose);
+    void lost(size_t id, size_t frame);
+    // passes the records of frame on to the writer; never waits for the disk
+    void commit(size_t frame);
+    // takes back everything from frame on: the tracks in dropped go, the
+    // others end before frame. Passed on to the writer like commit().
+    void rollback(size_t frame, const std::vector<size_t> &dropped);
+    // waits until the writer has journaled and synced everything committed
+    // so far; false if the journal has failed
+    bool flush();
+
+private:
+    enum RecordType : uint32_t {
+        PoseRecord = 1,
+        PromotionRecord,
+        LostRecord,
+        // closes the records of one frame, recovery stops at the last one
+        FrameRecord,
+        // a track taken back by the following rollback
+        DropRecord,
+        // closes a rollback like FrameRecord closes a frame
+        RollbackRecord
+    };
+
+    struct Record {
+        uint32_t type;
+        uint32_t checksum;
+        uint64_t id;
+        uint64_t frame;
+        float    center[2];
+        float    size[2];
+        float    rectangleAngle;
+        float    angle;
+        float    color[4];
+        uint32_t age;
+        int32_t  score;
+        uint32_t candidate;
+        uint32_t reserved;
+    };
+
+    static const std::chrono::milliseconds SyncInterval;
+
+    static Record makeRecord(RecordType type, size_t id, size_t frame);
+    static uint32_t checksum(const Record &record);
+
+    void run();
+    void start();
+    void stop();
+    // checksums the pending records and hands them to the writer
+    void submit();
+
+    // writer side: the tracks as journaled since the last checkpoint
+    void apply(const Record &record);
+    Trajectory &track(size_t id);
+    void clearTracks();
+    bool dropped(size_t id) const;
+    // applies a rollback to the tracks and to the segments it reaches into
+    void rollbackTracks(size_t frame);
+    bool rollbackSegments(size_t frame);
+    // writes the tracks into the next segment and starts them and the
+    // journal over
+    bool checkpoint();
+    bool sync();
+    QString segmentPath(size_t segment) const;
+    // merges the segments and the journal into recovered, keeps the journal
+    // tail as the tracks and cuts it after its last complete frame
+    bool recover(std::vector<BioTracker::Core::TrackedObject> &recovered);
+
+    QString                 _base;
+    QFile                   _journal;
+    size_t                  _checkpointInterval;
+
+    // records of the frame being mapped, only touched by the tracking thread
+    std::vector<Record>     _pending;
+
+    std::mutex              _lock;
+    std::condition_variable _changed;
+    std::vector<Record>     _queue;
+    bool                    _stop;
+    std::thread             _writer;
+
+    // segments written so far
+    size_t                  _segments;
+    std::vector<size_t>     _ids;
+    std::vector<Trajectory> _trajectories;
+    std::unordered_map<size_t, size_t> _trackIndex;
+    // drop records of the rollback being applied
+    std::vector<size_t>     _dropped;
+    size_t                  _lastFrame;
+    size_t                  _checkpointFrame;
+    bool                    _unsynced;
+    std::atomic<bool>       _failed;
+    std::chrono::steady_clock::time_point _lastSync;
+};
+
+#endif
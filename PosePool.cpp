@@ -0,0 +1,154 @@
+#include "PosePool.h"
+
+#include <new>
+
+// returns a thread's free blocks to the depot when the thread exits
+class PosePool::ThreadCacheRelease {
+public:
+    ~ThreadCacheRelease() {
+        ThreadCache &cache = threadCache();
+        PosePool::instance().releaseAll(cache);
+        cache.retired = true;
+    }
+};
+
+PosePool &PosePool::instance() {
+    // never destroyed: poses may still be released during static destruction
+    static PosePool *pool = new PosePool();
+    return *pool;
+}
+
+PosePool::PosePool()
+    : _allocations(0)
+    , _deallocations(0)
+    , _heapAllocations(0)
+{}
+
+void *PosePool::allocate(size_t size) {
+    const size_t sizeClass = (size + Granularity - 1) / Granularity;
+    _allocations.fetch_add(1, std::memory_order_relaxed);
+    if (sizeClass == 0 || sizeClass > SizeClasses) {
+        _heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(size);
+    }
+
+    ThreadCache &cache = threadCache();
+    if (cache.retired) {
+        FreeList list = {nullptr, 0};
+        refill(sizeClass, list);
+        void *block = list.pop();
+        if (list.count > 0) {
+            release(sizeClass, list);
+        }
+        return block;
+    }
+    FreeList &list = cache.lists[sizeClass - 1];
+    if (list.count == 0) {
+        refill(sizeClass, list);
+    }
+    return list.pop();
+}
+
+void PosePool::deallocate(void *block, size_t size) {
+    const size_t sizeClass = (size + Granularity - 1) / Granularity;
+    _deallocations.fetch_add(1, std::memory_order_relaxed);
+    if (sizeClass == 0 || sizeClass > SizeClasses) {
+        ::operator delete(block);
+        return;
+    }
+
+    ThreadCache &cache = threadCache();
+    if (cache.retired) {
+        FreeList list = {nullptr, 0};
+        list.push(block);
+        release(sizeClass, list);
+        return;
+    }
+    FreeList &list = cache.lists[sizeClass - 1];
+    list.push(block);
+    // a thread that mostly frees (e.g. the one dropping old tracks) passes
+    // the blocks on instead of hoarding them
+    if (list.count > ThreadCacheLimit) {
+        release(sizeClass, list.split(BlocksPerChunk));
+    }
+}
+
+PosePool::Counters PosePool::counters() const {
+    // every deallocation follows its allocation, so reading them in this
+    // order never gives fewer allocations than deallocations
+    const size_t deallocations = _deallocations.load(std::memory_order_relaxed);
+    const size_t allocations = _allocations.load(std::memory_order_relaxed);
+    return Counters{allocations, _heapAllocations.load(std::memory_order_relaxed), allocations - deallocations};
+}
+
+// ================ P R I V A T E ===================
+
+void PosePool::FreeList::push(void *block) {
+    *static_cast<void **>(block) = head;
+    head = block;
+    count++;
+}
+
+void *PosePool::FreeList::pop() {
+    void *block = head;
+    head = *static_cast<void **>(block);
+    count--;
+    return block;
+}
+
+PosePool::FreeList PosePool::FreeList::split(size_t n) {
+    FreeList first = {head, n};
+    void *last = head;
+    for (size_t i = 1; i < n; i++) {
+        last = *static_cast<void **>(last);
+    }
+    head = *static_cast<void **>(last);
+    *static_cast<void **>(last) = nullptr;
+    count -= n;
+    return first;
+}
+
+PosePool::ThreadCache &PosePool::threadCache() {
+    // zero-initialized, so no guard on every access
+    static thread_local ThreadCache cache;
+    if (!cache.registered) {
+        cache.registered = true;
+        static thread_local ThreadCacheRelease release;
+        (void)release;
+    }
+    return cache;
+}
+
+void PosePool::refill(size_t sizeClass, FreeList &list) {
+    {
+        std::lock_guard<std::mutex> lock(_depotLock);
+        std::vector<FreeList> &depot = _depot[sizeClass - 1];
+        if (!depot.empty()) {
+            list = depot.back();
+            depot.pop_back();
+            return;
+        }
+    }
+    // chunks are kept for the lifetime of the process, the pool only grows
+    // up to the largest number of poses alive at once
+    const size_t blockSize = sizeClass * Granularity;
+    char *chunk = static_cast<char *>(::operator new(blockSize * BlocksPerChunk));
+    _heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = BlocksPerChunk; i > 0; i--) {
+        list.push(chunk + (i - 1) * blockSize);
+    }
+}
+
+void PosePool::release(size_t sizeClass, FreeList list) {
+    std::lock_guard<std::mutex> lock(_depotLock);
+    _depot[sizeClass - 1].push_back(list);
+}
+
+void PosePool::releaseAll(ThreadCache &cache) {
+    for (size_t i = 0; i < SizeClasses; i++) {
+        if (cache.lists[i].count > 0) {
+            release(i + 1, cache.lists[i]);
+            cache.lists[i] = FreeList{nullptr, 0};
+        }
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef POSE_POOL_H
+#define POSE_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Recycles the small blocks std::allocate_shared requests for poses (object
+// and control block in one). Blocks come from chunks and go back to a free
+// list of their size class instead of the heap, so the heap does not get
+// fragmented by millions of short-lived poses in long runs.
+//
+// Every thread keeps its own free lists; only whole batches of blocks move
+// between threads through a shared depot, so the mapping worker and the
+// offline chunk threads do not contend on every pose. A block freed on
+// another thread than it was allocated on simply joins that thread's lists.
+class PosePool {
+public:
+    struct Counters {
+        // blocks handed out so far
+        size_t allocations;
+        // heap requests so far (chunks and oversized blocks)
+        size_t heapAllocations;
+        // blocks currently in use
+        size_t live;
+    };
+
+    static PosePool &instance();
+
+    void *allocate(size_t size);
+    void deallocate(void *block, size_t size);
+
+    Counters counters() const;
+
+private:
+    static const size_t Granularity = 16;
+    static const size_t SizeClasses = 16;
+    static const size_t BlocksPerChunk = 256;
+    // a thread hands a batch to the depot once it holds more free blocks
+    // of a size class than that
+    static const size_t ThreadCacheLimit = 2 * BlocksPerChunk;
+
+    // singly linked through the first word of each free block
+    struct FreeList {
+        void   *head;
+        size_t  count;
+
+        void push(void *block);
+        void *pop();
+        // moves the first count blocks into a list of their own
+        FreeList split(size_t count);
+    };
+
+    // per thread; trivially destructible so it is still usable while other
+    // thread locals are destroyed
+    struct ThreadCache {
+        FreeList    lists[SizeClasses];
+        bool        registered;
+        // the thread is exiting and its lists went to the depot
+        bool        retired;
+    };
+    class ThreadCacheRelease;
+
+    PosePool();
+
+    static ThreadCache &threadCache();
+    // refills an empty list from the depot or a new chunk
+    void refill(size_t sizeClass, FreeList &list);
+    void release(size_t sizeClass, FreeList list);
+    void releaseAll(ThreadCache &cache);
+
+    std::atomic<size_t> _allocations;
+    std::atomic<size_t> _deallocations;
+    std::atomic<size_t> _heapAllocations;
+
+    // batches of free blocks no thread holds
+    std::mutex              _depotLock;
+    std::vector<FreeList>   _depot[SizeClasses];
+};
+
+// Standard allocator on top of PosePool, for std::allocate_shared.
+template <class T>
+class PoseAllocator {
+public:
+    typedef T value_type;
+
+    PoseAllocator() {}
+    template <class U>
+    PoseAllocator(const PoseAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(PosePool::instance().allocate(n * sizeof(T)));
+    }
+    void deallocate(T *block, size_t n) {
+        PosePool::instance().deallocate(block, n * sizeof(T));
+    }
+
+    template <class U>
+    bool operator==(const PoseAllocator<U> &) const { return true; }
+    template <class U>
+    bool operator!=(const PoseAllocator<U> &) const { return false; }
+};
+
+template <class T, class... Args>
+std::shared_ptr<T> allocatePose(Args&&... args) {
+    return std::allocate_shared<T>(PoseAllocator<T>(), std::forward<Args>(args)...);
+}
+
+#endif
@@ -0,0 +1,224 @@
+#include "PoseRetention.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+using namespace BioTracker::Core;
+
+const size_t PoseRetention::MinimumWindow;
+
+PoseRetention::PoseRetention()
+    : _window(0)
+    , _spill(false)
+    , _cachedId(0)
+    , _cachedOffset(-1)
+{}
+
+PoseRetention::~PoseRetention() {}
+
+void PoseRetention::setWindow(size_t window) {
+    _window = window == 0 ? 0 : std::max(window, MinimumWindow);
+}
+
+size_t PoseRetention::window() const {
+    return _window;
+}
+
+void PoseRetention::setSpill(bool spill) {
+    _spill = spill;
+}
+
+void PoseRetention::retain(TrackedObject &object, size_t frame, size_t &retainedFrom, bool archive) {
+    if (_window == 0 || frame < 2 * _window) {
+        return;
+    }
+    const boost::optional<size_t> lastFrame = object.getLastFrameNumber();
+    if (!lastFrame) {
+        return;
+    }
+    const size_t last = std::min(lastFrame.get(), frame);
+    retainedFrom = firstInMemory(object, last, retainedFrom);
+    // trim in batches of a window so the copying below stays amortized O(1)
+    if (frame + 1 - retainedFrom < 2 * _window) {
+        return;
+    }
+    if (archive && _spill && !spillFile()) {
+        return;
+    }
+
+    const size_t keepFrom = frame + 1 - _window;
+    const size_t id = object.getId();
+    if (archive) {
+        Trajectory &pending = _pending[id];
+        // a track that has ended has nothing after its last pose
+        for (size_t i = retainedFrom; i < std::min(keepFrom, last + 1); i++) {
+            if (object.hasValuesAtFrame(i)) {
+                pending.add(i, *object.get<FishPose>(i));
+            }
+        }
+        if (pending.endFrame() - pending.firstFrame() >= BlockFrames) {
+            write(id, pending);
+        }
+    }
+
+    // TrackedObject cannot drop single frames, so the recent ones move to a fresh object
+    TrackedObject kept(id);
+    for (size_t i = keepFrom; i <= frame; i++) {
+        if (object.hasValuesAtFrame(i)) {
+            kept.add(i, object.get<ObjectModel>(i));
+        }
+    }
+    object = std::move(kept);
+    retainedFrom = keepFrom;
+}
+
+void PoseRetention::flush(size_t id) {
+    auto pending = _pending.find(id);
+    if (pending == _pending.end()) {
+        return;
+    }
+    write(id, pending->second);
+    _pending.erase(pending);
+}
+
+void PoseRetention::retire(TrackedObject &object, size_t &retainedFrom) {
+    if (_window == 0) {
+        return;
+    }
+    const size_t id = object.getId();
+    const boost::optional<size_t> lastFrame = object.getLastFrameNumber();
+    if (lastFrame && !(_spill && !spillFile())) {
+        Trajectory &pending = _pending[id];
+        for (size_t i = firstInMemory(object, lastFrame.get(), retainedFrom); i <= lastFrame.get(); i++) {
+            if (object.hasValuesAtFrame(i)) {
+                pending.add(i, *object.get<FishPose>(i));
+            }
+        }
+        object = TrackedObject(id);
+        retainedFrom = std::numeric_limits<size_t>::max();
+    }
+    flush(id);
+}
+
+std::shared_ptr<FishPose> PoseRetention::archived(size_t id, size_t frame) {
+    auto pending = _pending.find(id);
+    if (pending != _pending.end() && !pending->second.empty() && pending->second.firstFrame() <= frame) {
+        return pending->second.get<FishPose>(frame);
+    }
+
+    auto blocks = _blocks.find(id);
+    if (blocks == _blocks.end()) {
+        return nullptr;
+    }
+    // the last block starting at or before frame
+    const std::vector<Block> &trackBlocks = blocks->second;
+    auto block = std::upper_bound(trackBlocks.begin(), trackBlocks.end(), frame,
+                                  [](size_t value, const Block &candidate) { return value < candidate.firstFrame; });
+    if (block == trackBlocks.begin() || (--block)->endFrame <= frame) {
+        return nullptr;
+    }
+    if (block->offset < 0) {
+        return block->columns.get<FishPose>(frame);
+    }
+    if (_cachedId != id || _cachedOffset != block->offset) {
+        if (!read(*block, _cached)) {
+            _cachedOffset = -1;
+            return nullptr;
+        }
+        _cachedId = id;
+        _cachedOffset = block->offset;
+    }
+    return _cached.get<FishPose>(frame);
+}
+
+void PoseRetention::restore(std::vector<TrackedObject> &objects) {
+    Trajectory trajectory;
+    auto restoreFrames = [](TrackedObject &object, const Trajectory &frames) {
+        for (size_t frame = frames.firstFrame(); frame < frames.endFrame(); frame++) {
+            if (frames.hasValuesAtFrame(frame)) {
+                object.add(frame, frames.get<FishPose>(frame));
+            }
+        }
+    };
+    for (TrackedObject &object : objects) {
+        auto blocks = _blocks.find(object.getId());
+        if (blocks != _blocks.end()) {
+            for (const Block &block : blocks->second) {
+                if (block.offset < 0) {
+                    restoreFrames(object, block.columns);
+                } else if (read(block, trajectory)) {
+                    restoreFrames(object, trajectory);
+                }
+            }
+        }
+        auto pending = _pending.find(object.getId());
+        if (pending != _pending.end()) {
+            restoreFrames(object, pending->second);
+        }
+    }
+    clear();
+}
+
+void PoseRetention::clear() {
+    _pending.clear();
+    _blocks.clear();
+    _cached.clear();
+    _cachedOffset = -1;
+    if (_file.isOpen()) {
+        _file.resize(0);
+    }
+}
+
+// ================ P R I V A T E ===================
+
+bool PoseRetention::spillFile() {
+    return _file.isOpen() || _file.open();
+}
+
+size_t PoseRetention::firstInMemory(const TrackedObject &object, size_t last, size_t retainedFrom) {
+    if (retainedFrom != std::numeric_limits<size_t>::max()) {
+        return retainedFrom;
+    }
+    // tracks get a pose every frame while they last, so the first one is
+    // where the run back from the last one ends
+    size_t first = last;
+    while (first > 0 && object.hasValuesAtFrame(first - 1)) {
+        first--;
+    }
+    return first;
+}
+
+void PoseRetention::write(size_t id, Trajectory &trajectory) {
+    if (trajectory.empty()) {
+        return;
+    }
+    Block block;
+    block.firstFrame = trajectory.firstFrame();
+    block.endFrame = trajectory.endFrame();
+    if (!_spill) {
+        block.offset = -1;
+        block.size = 0;
+        std::swap(block.columns, trajectory);
+        _blocks[id].push_back(std::move(block));
+        return;
+    }
+    if (!spillFile()) {
+        return;
+    }
+    trajectory.serialize(_bytes);
+    block.offset = _file.size();
+    block.size = static_cast<qint64>(_bytes.size());
+    if (!_file.seek(block.offset) || _file.write(_bytes.data(), block.size) != block.size) {
+        // keep them buffered rather than losing them
+        return;
+    }
+    _blocks[id].push_back(std::move(block));
+    trajectory.clear();
+}
+
+bool PoseRetention::read(const Block &block, Trajectory &trajectory) {
+    _bytes.resize(static_cast<size_t>(block.size));
+    return _file.seek(block.offset) && _file.read(_bytes.data(), block.size) == block.size
+           && trajectory.deserialize(_bytes.data(), _bytes.size());
+}
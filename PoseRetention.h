@@ -0,0 +1,91 @@
+#ifndef POSE_RETENTION_H
+#define POSE_RETENTION_H
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <QTemporaryFile>
+
+#include <biotracker/serialization/TrackedObject.h>
+
+#include "FishPose.h"
+#include "Trajectory.h"
+
+// Keeps only the most recent frames of each track as FishPose objects. Older
+// poses of tracks are collected in columnar Trajectory blocks, about 32 bytes
+// a frame instead of a shared FishPose in the track's map. The blocks stay in
+// memory, or with spilling go to an anonymous scratch file, leaving only
+// their index in memory. archived() still finds the poses for painting and
+// restore() brings them back before saving.
+class PoseRetention {
+public:
+    PoseRetention();
+    ~PoseRetention();
+
+    // frames kept in memory per track, at least MinimumWindow; 0 keeps everything
+    void setWindow(size_t window);
+    size_t window() const;
+    // whether blocks written from now on go to the spill file
+    void setSpill(bool spill);
+
+    static const size_t MinimumWindow = 32;
+
+    // Trims object to the last window frames up to frame once twice that
+    // many have built up. The poses taken out go to the archive if archive is
+    // set, otherwise they are discarded. retainedFrom is the caller's record
+    // of the first frame still in memory, size_t max if not known yet.
+    void retain(BioTracker::Core::TrackedObject &object, size_t frame, size_t &retainedFrom, bool archive);
+
+    // writes out what is still buffered for a track, once it has ended
+    void flush(size_t id);
+    // Moves every pose of a track that has ended into the archive and writes
+    // out its last block, leaving object without poses in memory.
+    // retainedFrom as for retain(), size_t max afterwards.
+    void retire(BioTracker::Core::TrackedObject &object, size_t &retainedFrom);
+
+    // the archived pose of track id at frame, nullptr if there is none
+    std::shared_ptr<FishPose> archived(size_t id, size_t frame);
+
+    // adds all archived poses back to their tracks and empties the archive
+    void restore(std::vector<BioTracker::Core::TrackedObject> &objects);
+
+    void clear();
+
+private:
+    struct Block {
+        uint64_t    firstFrame;
+        uint64_t    endFrame;
+        // location in the spill file, offset -1 if the block is in columns
+        qint64      offset;
+        qint64      size;
+        Trajectory  columns;
+    };
+
+    // frames per track collected before they are written as one block
+    static const size_t BlockFrames = 4096;
+
+    // opens the spill file on first use; tracks are not trimmed if it fails
+    bool spillFile();
+    // retainedFrom if known, otherwise the first frame of the run of poses
+    // ending at last
+    static size_t firstInMemory(const BioTracker::Core::TrackedObject &object, size_t last, size_t retainedFrom);
+    void write(size_t id, Trajectory &trajectory);
+    bool read(const Block &block, Trajectory &trajectory);
+
+    size_t          _window;
+    bool            _spill;
+    QTemporaryFile  _file;
+
+    std::unordered_map<size_t, Trajectory>         _pending;
+    std::unordered_map<size_t, std::vector<Block>> _blocks;
+
+    // the block read last, painting usually asks for neighbouring frames
+    size_t              _cachedId;
+    qint64              _cachedOffset;
+    Trajectory          _cached;
+    std::vector<char>   _bytes;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "SegmentationCache.h"
+
+SegmentationResult::SegmentationResult()
+    : frame(0)
+    , _foregroundRGBValid(false)
+{}
+
+const cv::Mat &SegmentationResult::foregroundRGB() {
+    if (!_foregroundRGBValid) {
+        cv::cvtColor(foreground, _foregroundRGB, cv::COLOR_GRAY2RGB);
+        _foregroundRGBValid = true;
+    }
+    return _foregroundRGB;
+}
+
+size_t SegmentationResult::bytes() const {
+    return frameGRAY.total() * frameGRAY.elemSize() + foreground.total() * foreground.elemSize()
+           + _foregroundRGB.total() * _foregroundRGB.elemSize();
+}
+
+const size_t SegmentationCache::DefaultByteBudget;
+
+SegmentationCache::SegmentationCache(size_t byteBudget)
+    : _byteBudget(byteBudget)
+{}
+
+std::shared_ptr<SegmentationResult> SegmentationCache::find(size_t frame, const TrackerParameters &parameters) {
+    std::lock_guard<std::mutex> lock(_lock);
+    for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+        if ((*it)->frame == frame) {
+            if (!(*it)->parameters.sameSegmentation(parameters)) {
+                return nullptr;
+            }
+            _entries.splice(_entries.begin(), _entries, it);
+            return _entries.front();
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<SegmentationResult> SegmentationCache::acquire(size_t frame, const TrackerParameters &parameters) {
+    std::shared_ptr<SegmentationResult> result;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        // a result like the oldest one would not fit anymore; only recycle it
+        // if nobody outside the cache still uses it
+        if (!_entries.empty() && bytes() + _entries.back()->bytes() > _byteBudget && _entries.back().use_count() == 1) {
+            result = _entries.back();
+            _entries.pop_back();
+        }
+    }
+    if (!result) {
+        result = std::make_shared<SegmentationResult>();
+    }
+    result->frame = frame;
+    result->parameters = parameters;
+    result->ellipses.clear();
+    result->_foregroundRGBValid = false;
+    return result;
+}
+
+void SegmentationCache::insert(const std::shared_ptr<SegmentationResult> &result) {
+    std::lock_guard<std::mutex> lock(_lock);
+    for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+        if ((*it)->frame == result->frame) {
+            _entries.erase(it);
+            break;
+        }
+    }
+    _entries.push_front(result);
+    while (_entries.size() > 1 && bytes() > _byteBudget) {
+        _entries.pop_back();
+    }
+}
+
+void SegmentationCache::clear() {
+    std::lock_guard<std::mutex> lock(_lock);
+    _entries.clear();
+}
+
+size_t SegmentationCache::bytes() const {
+    size_t total = 0;
+    for (const std::shared_ptr<SegmentationResult> &entry : _entries) {
+        total += entry->bytes();
+    }
+    return total;
+}
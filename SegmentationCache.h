@@ -0,0 +1,63 @@
+#ifndef SEGMENTATION_CACHE_H
+#define SEGMENTATION_CACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/opencv.hpp>
+
+#include "TrackerParameters.h"
+
+// Everything the segmentation produced for one frame.
+class SegmentationResult {
+public:
+    SegmentationResult();
+
+    size_t                                  frame;
+    TrackerParameters                       parameters;
+    cv::Mat                                 frameGRAY;
+    cv::Mat                                 foreground;
+    std::vector<cv::RotatedRect>            ellipses;
+
+    // RGB copy of the foreground for display, converted on first use only
+    const cv::Mat &foregroundRGB();
+    // memory held by the images
+    size_t bytes() const;
+
+private:
+    friend class SegmentationCache;
+
+    cv::Mat _foregroundRGB;
+    bool    _foregroundRGBValid;
+};
+
+// Small LRU cache of segmentation results keyed by frame number and the
+// segmentation parameters they were computed with, shared by track(), paint()
+// and paintOverlay(). Holds at most byteBudget bytes of images, but always the
+// latest result. Evicted results are recycled so their buffers are reused.
+class SegmentationCache {
+public:
+    static const size_t DefaultByteBudget = 128 * 1024 * 1024;
+
+    explicit SegmentationCache(size_t byteBudget = DefaultByteBudget);
+
+    // nullptr if the frame is unknown or was segmented with other parameters
+    std::shared_ptr<SegmentationResult> find(size_t frame, const TrackerParameters &parameters);
+
+    // an unregistered result to fill, recycled from the cache when possible
+    std::shared_ptr<SegmentationResult> acquire(size_t frame, const TrackerParameters &parameters);
+    void insert(const std::shared_ptr<SegmentationResult> &result);
+
+    void clear();
+
+private:
+    std::mutex                                      _lock;
+    size_t                                          _byteBudget;
+    // most recently used first
+    std::list<std::shared_ptr<SegmentationResult>>  _entries;
+
+    size_t bytes() const;
+};
+
+#endif
@@ -0,0 +1,254 @@
+#include "SegmentationEngine.h"
+
+#include "ForegroundExtractor.h"
+
+#include <algorithm>
+#include <numeric>
+
+class SegmentationEngine::TileBody : public cv::ParallelLoopBody {
+public:
+    TileBody(SegmentationEngine &engine, const cv::Mat &background, const cv::Mat &frameGRAY,
+             const TrackerParameters &parameters, cv::Mat &foreground)
+        : _engine(engine)
+        , _background(background)
+        , _frameGRAY(frameGRAY)
+        , _parameters(parameters)
+        , _foreground(foreground)
+    {}
+
+    void operator()(const cv::Range &range) const override {
+        for (int i = range.start; i < range.end; i++) {
+            _engine.processTile(_engine._tiles[static_cast<size_t>(i)], _background, _frameGRAY, _parameters, _foreground);
+        }
+    }
+
+private:
+    SegmentationEngine      &_engine;
+    const cv::Mat           &_background;
+    const cv::Mat           &_frameGRAY;
+    const TrackerParameters &_parameters;
+    cv::Mat                 &_foreground;
+};
+
+SegmentationEngine::SegmentationEngine()
+    : _threadCount(0)
+{}
+
+void SegmentationEngine::setThreadCount(size_t threadCount) {
+    _threadCount = threadCount;
+}
+
+size_t SegmentationEngine::threadCount() const {
+    return resolveThreadCount(_threadCount);
+}
+
+size_t SegmentationEngine::resolveThreadCount(size_t threadCount) {
+    return threadCount > 0 ? threadCount : static_cast<size_t>(std::max(cv::getNumberOfCPUs(), 1));
+}
+
+void SegmentationEngine::segment(const cv::Mat &background, const cv::Mat &frameGRAY, const TrackerParameters &parameters,
+                                 cv::Mat &foreground, std::vector<cv::RotatedRect> &ellipses)
+{
+    CV_Assert(background.size() == frameGRAY.size());
+    foreground.create(frameGRAY.size(), CV_8UC1);
+
+    const int count = std::max(1, std::min(static_cast<int>(threadCount()), frameGRAY.rows));
+    _tiles.resize(static_cast<size_t>(count));
+    for (int i = 0; i < count; i++) {
+        const int begin = frameGRAY.rows * i / count;
+        const int end = frameGRAY.rows * (i + 1) / count;
+        _tiles[static_cast<size_t>(i)].core = cv::Rect(0, begin, frameGRAY.cols, end - begin);
+    }
+
+    processTiles(background, frameGRAY, parameters, foreground);
+
+    mergeStrips(parameters, ellipses);
+}
+
+bool SegmentationEngine::segmentWindows(const cv::Mat &background, const cv::Mat &frameGRAY,
+                                        const TrackerParameters &parameters, std::vector<cv::Rect> windows,
+                                        cv::Mat &foreground, std::vector<cv::RotatedRect> &ellipses)
+{
+    CV_Assert(background.size() == frameGRAY.size());
+    foreground.create(frameGRAY.size(), CV_8UC1);
+    foreground.setTo(cv::Scalar(0));
+
+    // merge overlapping windows, so no pixel (and no blob) is seen twice
+    const cv::Rect image(0, 0, frameGRAY.cols, frameGRAY.rows);
+    for (cv::Rect &window : windows) {
+        window &= image;
+    }
+    windows.erase(std::remove_if(windows.begin(), windows.end(), [](const cv::Rect &window) { return window.area() == 0; }),
+                  windows.end());
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < windows.size() && !merged; i++) {
+            for (size_t j = i + 1; j < windows.size(); j++) {
+                if ((windows[i] & windows[j]).area() > 0) {
+                    windows[i] |= windows[j];
+                    windows.erase(windows.begin() + static_cast<std::ptrdiff_t>(j));
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    _tiles.resize(windows.size());
+    for (size_t i = 0; i < windows.size(); i++) {
+        _tiles[i].core = windows[i];
+    }
+
+    processTiles(background, frameGRAY, parameters, foreground);
+
+    _merged.clear();
+    bool complete = true;
+    for (const Tile &tile : _tiles) {
+        _merged.insert(_merged.end(), tile.blobs.begin(), tile.blobs.end());
+
+        // a blob reaching a window border that is not an image border was cut off
+        const cv::Mat core = foreground(tile.core);
+        const bool top = tile.core.y > 0;
+        const bool bottom = tile.core.y + tile.core.height < image.height;
+        const bool left = tile.core.x > 0;
+        const bool right = tile.core.x + tile.core.width < image.width;
+        for (int y = 0; y < core.rows && complete; y++) {
+            const uchar *row = core.ptr<uchar>(y);
+            if ((top && y == 0) || (bottom && y == core.rows - 1)) {
+                complete = std::find_if(row, row + core.cols, [](uchar v) { return v != 0; }) == row + core.cols;
+            } else {
+                complete = !(left && row[0] != 0) && !(right && row[core.cols - 1] != 0);
+            }
+        }
+    }
+
+    BlobExtractor::toEllipses(_merged, parameters.minBlobArea, parameters.maxBlobArea, ellipses);
+    return complete;
+}
+
+bool SegmentationEngine::segmentCoarseToFine(const cv::Mat &coarseBackground, const cv::Mat &coarseGRAY,
+                                             const cv::Mat &background, const cv::Mat &frameGRAY,
+                                             const TrackerParameters &parameters,
+                                             cv::Mat &foreground, std::vector<cv::RotatedRect> &ellipses)
+{
+    const size_t factor = std::max<size_t>(parameters.pyramidFactor, 1);
+    CV_Assert(coarseGRAY.size() == coarseSize(frameGRAY.size(), factor));
+
+    // rather find too much on the coarse level than too little, the full
+    // resolution pass applies the exact parameters anyway
+    TrackerParameters coarse = parameters;
+    coarse.numberOfErosions = parameters.numberOfErosions / factor;
+    coarse.numberOfDilations = (parameters.numberOfDilations + factor - 1) / factor;
+    coarse.minBlobArea = std::max<size_t>(parameters.minBlobArea / (factor * factor), 1);
+    coarse.maxBlobArea = (parameters.maxBlobArea + factor * factor - 1) / (factor * factor);
+    segment(coarseBackground, coarseGRAY, coarse, _coarseForeground, _coarseEllipses);
+
+    // a coarse pixel covers factor x factor full pixels; the margin also covers
+    // the blob parts outside the moment ellipse and the morphology halo
+    const int scale = static_cast<int>(factor);
+    const int margin = 2 * scale + static_cast<int>(parameters.numberOfErosions + parameters.numberOfDilations);
+    std::vector<cv::Rect> windows;
+    windows.reserve(_coarseEllipses.size());
+    for (const cv::RotatedRect &ellipse : _coarseEllipses) {
+        const cv::Rect box = ellipse.boundingRect();
+        windows.push_back(cv::Rect(box.x * scale - margin, box.y * scale - margin,
+                                   box.width * scale + 2 * margin, box.height * scale + 2 * margin));
+    }
+
+    return segmentWindows(background, frameGRAY, parameters, windows, foreground, ellipses);
+}
+
+cv::Size SegmentationEngine::coarseSize(const cv::Size &size, size_t factor) {
+    const int scale = static_cast<int>(std::max<size_t>(factor, 1));
+    return cv::Size((size.width + scale - 1) / scale, (size.height + scale - 1) / scale);
+}
+
+// ================ P R I V A T E ===================
+
+void SegmentationEngine::processTiles(const cv::Mat &background, const cv::Mat &frameGRAY,
+                                      const TrackerParameters &parameters, cv::Mat &foreground)
+{
+    const int count = static_cast<int>(_tiles.size());
+    cv::parallel_for_(cv::Range(0, count), TileBody(*this, background, frameGRAY, parameters, foreground), count);
+}
+
+void SegmentationEngine::processTile(Tile &tile, const cv::Mat &background, const cv::Mat &frameGRAY,
+                                     const TrackerParameters &parameters, cv::Mat &foreground) const
+{
+    // the erosion and dilation windows reach that many pixels across the
+    // artificial tile border, so as many extra pixels are computed and dropped
+    const int halo = static_cast<int>(parameters.numberOfErosions + parameters.numberOfDilations);
+    const cv::Rect padded = cv::Rect(tile.core.x - halo, tile.core.y - halo,
+                                     tile.core.width + 2 * halo, tile.core.height + 2 * halo)
+                            & cv::Rect(0, 0, frameGRAY.cols, frameGRAY.rows);
+
+    ForegroundExtractor::extract(background(padded), frameGRAY(padded), tile.buffer,
+                                 parameters.polarity, parameters.diffThreshold);
+
+    tile.morphology.apply(tile.buffer, parameters.numberOfErosions, parameters.numberOfDilations);
+
+    cv::Mat core = foreground(tile.core);
+    tile.buffer(cv::Rect(tile.core.x - padded.x, tile.core.y - padded.y, tile.core.width, tile.core.height)).copyTo(core);
+
+    tile.extractor.measure(core, tile.core.tl(), frameGRAY.cols, tile.blobs);
+}
+
+void SegmentationEngine::mergeStrips(const TrackerParameters &parameters, std::vector<cv::RotatedRect> &ellipses) {
+    // blob i of strip s gets the global label offsets[s] + i
+    std::vector<size_t> offsets(_tiles.size(), 0);
+    _merged.clear();
+    for (size_t s = 0; s < _tiles.size(); s++) {
+        offsets[s] = _merged.size();
+        _merged.insert(_merged.end(), _tiles[s].blobs.begin(), _tiles[s].blobs.end());
+    }
+
+    _parents.resize(_merged.size());
+    std::iota(_parents.begin(), _parents.end(), 0);
+
+    // 8-connectivity across each strip border: last row of the upper strip
+    // against the first row of the lower one
+    for (size_t s = 0; s + 1 < _tiles.size(); s++) {
+        const cv::Mat &upperLabels = _tiles[s].extractor.labels();
+        const cv::Mat &lowerLabels = _tiles[s + 1].extractor.labels();
+        const int *upper = upperLabels.ptr<int>(upperLabels.rows - 1);
+        const int *lower = lowerLabels.ptr<int>(0);
+        for (int x = 0; x < upperLabels.cols; x++) {
+            if (upper[x] == 0) continue;
+            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, lowerLabels.cols - 1); nx++) {
+                if (lower[nx] == 0) continue;
+                unite(offsets[s] + static_cast<size_t>(upper[x] - 1),
+                      offsets[s + 1] + static_cast<size_t>(lower[nx] - 1));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < _merged.size(); i++) {
+        const size_t root = find(i);
+        if (root != i) {
+            _merged[root].merge(_merged[i]);
+            _merged[i] = BlobMoments();
+        }
+    }
+
+    BlobExtractor::toEllipses(_merged, parameters.minBlobArea, parameters.maxBlobArea, ellipses);
+}
+
+void SegmentationEngine::unite(size_t a, size_t b) {
+    a = find(a);
+    b = find(b);
+    // the smaller label stays the root, so roots always precede their members
+    if (a < b) {
+        _parents[b] = a;
+    } else if (b < a) {
+        _parents[a] = b;
+    }
+}
+
+size_t SegmentationEngine::find(size_t label) {
+    while (_parents[label] != label) {
+        _parents[label] = _parents[_parents[label]];
+        label = _parents[label];
+    }
+    return label;
+}
@@ -0,0 +1,71 @@
+#ifndef SEGMENTATION_ENGINE_H
+#define SEGMENTATION_ENGINE_H
+
+#include <opencv2/opencv.hpp>
+
+#include "BlobExtractor.h"
+#include "Morphology.h"
+#include "TrackerParameters.h"
+
+// Difference, thresholding, morphology and blob extraction, split into tiles
+// that are processed in parallel. Every tile is computed with a halo of one
+// pixel per erosion/dilation so the morphology is exact. For full frames the
+// tiles are horizontal strips and blobs crossing strip borders are merged
+// afterwards, so the result does not depend on the number of strips.
+class SegmentationEngine {
+public:
+    SegmentationEngine();
+
+    // number of tiles processed concurrently, 0 = one per cpu
+    void setThreadCount(size_t threadCount);
+    size_t threadCount() const;
+    static size_t resolveThreadCount(size_t threadCount);
+
+    void segment(const cv::Mat &background, const cv::Mat &frameGRAY, const TrackerParameters &parameters,
+                 cv::Mat &foreground, std::vector<cv::RotatedRect> &ellipses);
+
+    // segments only inside the given windows; the foreground is zero elsewhere.
+    // Overlapping windows are merged first. Returns false if a blob touches a
+    // window border inside the image, i.e. might continue outside the window.
+    bool segmentWindows(const cv::Mat &background, const cv::Mat &frameGRAY, const TrackerParameters &parameters,
+                        std::vector<cv::Rect> windows, cv::Mat &foreground, std::vector<cv::RotatedRect> &ellipses);
+
+    // coarse-to-fine: finds blobs on a level downsampled by parameters.pyramidFactor,
+    // with morphology radii and area limits scaled to it, and segments the full
+    // resolution frame only around them. Returns false like segmentWindows.
+    bool segmentCoarseToFine(const cv::Mat &coarseBackground, const cv::Mat &coarseGRAY,
+                             const cv::Mat &background, const cv::Mat &frameGRAY, const TrackerParameters &parameters,
+                             cv::Mat &foreground, std::vector<cv::RotatedRect> &ellipses);
+
+    // size of the level downsampled by factor, rounded up
+    static cv::Size coarseSize(const cv::Size &size, size_t factor);
+
+private:
+    struct Tile {
+        cv::Rect                    core;
+        cv::Mat                     buffer;
+        Morphology                  morphology;
+        BlobExtractor               extractor;
+        std::vector<BlobMoments>    blobs;
+    };
+
+    class TileBody;
+
+    void processTiles(const cv::Mat &background, const cv::Mat &frameGRAY, const TrackerParameters &parameters,
+                      cv::Mat &foreground);
+    void processTile(Tile &tile, const cv::Mat &background, const cv::Mat &frameGRAY,
+                     const TrackerParameters &parameters, cv::Mat &foreground) const;
+    void mergeStrips(const TrackerParameters &parameters, std::vector<cv::RotatedRect> &ellipses);
+
+    void unite(size_t a, size_t b);
+    size_t find(size_t label);
+
+    size_t                      _threadCount;
+    std::vector<Tile>           _tiles;
+    std::vector<size_t>         _parents;
+    std::vector<BlobMoments>    _merged;
+    cv::Mat                     _coarseForeground;
+    std::vector<cv::RotatedRect> _coarseEllipses;
+};
+
+#endif
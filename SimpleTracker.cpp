@@ -5,11 +5,17 @@
 #include <QSlider>
 #include <QGroupBox>
 #include <QPushButton>
+#include <QCheckBox>
+#include <QFileDialog>
+#include <QMessageBox>
 
 #include "TrackedFish.h"
+#include "TrajectoryFile.h"
 
 #include <QGraphicsEllipseItem>
 
+#include <limits>
+
 #include <biotracker/Registry.h>
 
 using namespace BioTracker::Core;
@@ -26,26 +32,42 @@ extern "C" {
 
 SimpleTracker::SimpleTracker(BioTracker::Core::Settings &settings)
     : TrackingAlgorithm(settings)
-    , _backgroundInitialized(false)
-    , _numberOfObjects(6)
-    , _averageSpeedPx(75.0f)
-    , _minContourSize(new QLabel("5", getToolsWidget()))
-    , _maxContourSize(new QLabel("1500", getToolsWidget()))
-    , _numberOfErosions(new QLabel("3", getToolsWidget()))
-    , _numberOfDilations(new QLabel("1", getToolsWidget()))
-    , _backgroundWeight(new QLabel("0.95", getToolsWidget()))
-    , _diffThreshold(new QLabel("15", getToolsWidget()))
-    , _framesTillPromotion(new QLabel("30", getToolsWidget()))
-    , _mapper(new Mapper(m_trackedObjects, _numberOfObjects, _framesTillPromotion->text().toUInt()))
+    , _lastFullFrame(std::numeric_limits<size_t>::max())
+    , _lastTrackedFrame(std::numeric_limits<size_t>::max())
+    , _minBlobArea(new QLabel(getToolsWidget()))
+    , _maxBlobArea(new QLabel(getToolsWidget()))
+    , _numberOfErosions(new QLabel(getToolsWidget()))
+    , _numberOfDilations(new QLabel(getToolsWidget()))
+    , _backgroundWeight(new QLabel(getToolsWidget()))
+    , _diffThreshold(new QLabel(getToolsWidget()))
+    , _framesTillPromotion(new QLabel(getToolsWidget()))
+    , _segmentationThreads(new QLabel(getToolsWidget()))
+    , _fullFrameInterval(new QLabel(getToolsWidget()))
+    , _pyramidFactor(new QLabel(getToolsWidget()))
+    , _pipeline([this](MappingPipeline::Job &job) { mapFrame(job); })
 {
-    FishPose::_averageSpeed = _averageSpeedPx;
-    FishPose::_averageSpeedSigma = std::sqrt(-(_averageSpeedPx*_averageSpeedPx/2) * (1/std::log(0.33f)));
+    const TrackerParameters parameters = _parameters.snapshot();
+    _mapper.reset(new Mapper(m_trackedObjects, parameters.numberOfObjects, parameters.framesTillPromotion));
+    _mapper->setJournal(&_journal);
+    applyMappingParameters(parameters);
+
+    _minBlobArea->setText(QString::number(parameters.minBlobArea));
+    _maxBlobArea->setText(QString::number(parameters.maxBlobArea));
+    _numberOfErosions->setText(QString::number(parameters.numberOfErosions));
+    _numberOfDilations->setText(QString::number(parameters.numberOfDilations));
+    _backgroundWeight->setText(QString::number(parameters.backgroundWeight));
+    _diffThreshold->setText(QString::number(parameters.diffThreshold));
+    _framesTillPromotion->setText(QString::number(parameters.framesTillPromotion));
+    _segmentationThreads->setText(QString::number(parameters.segmentationThreads));
+    _fullFrameInterval->setText(QString::number(parameters.fullFrameInterval));
+    _pyramidFactor->setText(QString::number(parameters.pyramidFactor));
+
     // initialize gui
     auto ui = getToolsWidget();
     auto layout = new QGridLayout();
 
     auto numberOfObjects = new QLineEdit();
-    numberOfObjects->setText(QString::number(_numberOfObjects));
+    numberOfObjects->setText(QString::number(parameters.numberOfObjects));
     connect(numberOfObjects, SIGNAL(textChanged(const QString &)), this, SLOT(setNumberOfObjects(const QString &)));
     layout->addWidget(new QLabel("number of objects"), 0, 0, 1, 2);
     layout->addWidget(numberOfObjects, 0, 2, 1, 1);
@@ -54,7 +76,12 @@ SimpleTracker::SimpleTracker(BioTracker::Core::Settings &settings)
     _darker = new QRadioButton(tr("Darker"));
     _brighter = new QRadioButton(tr("Brighter"));
     _both = new QRadioButton(tr("Both"));
-    _darker->setChecked(true);
+    _darker->setChecked(parameters.polarity == ForegroundExtractor::Darker);
+    _brighter->setChecked(parameters.polarity == ForegroundExtractor::Brighter);
+    _both->setChecked(parameters.polarity == ForegroundExtractor::Both);
+    connect(_darker, SIGNAL(toggled(bool)), this, SLOT(setPolarity()));
+    connect(_brighter, SIGNAL(toggled(bool)), this, SLOT(setPolarity()));
+    connect(_both, SIGNAL(toggled(bool)), this, SLOT(setPolarity()));
 
     QHBoxLayout *hbox = new QHBoxLayout;
     hbox->addWidget(_darker);
@@ -64,33 +91,33 @@ SimpleTracker::SimpleTracker(BioTracker::Core::Settings &settings)
     layout->addWidget(groupBox, 1, 0, 1, 3);
 
     auto averageSpeedPx = new QLineEdit();
-    averageSpeedPx->setText(QString::number(_averageSpeedPx));
+    averageSpeedPx->setText(QString::number(parameters.averageSpeedPx));
     connect(averageSpeedPx, SIGNAL(textChanged(const QString &)), this, SLOT(setAverageSpeedPx(const QString &)));
     layout->addWidget(new QLabel("average speed (px/frame)"), 2, 0, 1, 2);
     layout->addWidget(averageSpeedPx, 2, 2, 1, 1);
 
-    auto minContourSize = new QSlider(Qt::Horizontal);
-    minContourSize->setMinimum(5);
-    minContourSize->setMaximum(250);
-    minContourSize->setValue(_minContourSize->text().toInt());
-    connect(minContourSize, SIGNAL(valueChanged(int)), this, SLOT(setMinContourSize(int)));
-    layout->addWidget(new QLabel("minimal contour size"), 3, 0, 1, 2);
-    layout->addWidget(_minContourSize, 3, 2, 1, 1);
-    layout->addWidget(minContourSize, 4, 0, 1, 3);
-
-    auto maxContourSize = new QSlider(Qt::Horizontal);
-    maxContourSize->setMinimum(5);
-    maxContourSize->setMaximum(1500);
-    maxContourSize->setValue(_maxContourSize->text().toInt());
-    connect(maxContourSize, SIGNAL(valueChanged(int)), this, SLOT(setMaxContourSize(int)));
-    layout->addWidget(new QLabel("maximal contour size"), 5, 0, 1, 2);
-    layout->addWidget(_maxContourSize, 5, 2, 1, 1);
-    layout->addWidget(maxContourSize, 6, 0, 1, 3);
+    auto minBlobArea = new QSlider(Qt::Horizontal);
+    minBlobArea->setMinimum(1);
+    minBlobArea->setMaximum(2500);
+    minBlobArea->setValue(static_cast<int>(parameters.minBlobArea));
+    connect(minBlobArea, SIGNAL(valueChanged(int)), this, SLOT(setMinBlobArea(int)));
+    layout->addWidget(new QLabel("minimal blob area (px)"), 3, 0, 1, 2);
+    layout->addWidget(_minBlobArea, 3, 2, 1, 1);
+    layout->addWidget(minBlobArea, 4, 0, 1, 3);
+
+    auto maxBlobArea = new QSlider(Qt::Horizontal);
+    maxBlobArea->setMinimum(10);
+    maxBlobArea->setMaximum(50000);
+    maxBlobArea->setValue(static_cast<int>(parameters.maxBlobArea));
+    connect(maxBlobArea, SIGNAL(valueChanged(int)), this, SLOT(setMaxBlobArea(int)));
+    layout->addWidget(new QLabel("maximal blob area (px)"), 5, 0, 1, 2);
+    layout->addWidget(_maxBlobArea, 5, 2, 1, 1);
+    layout->addWidget(maxBlobArea, 6, 0, 1, 3);
 
     auto numberOfErosions = new QSlider(Qt::Horizontal);
     numberOfErosions->setMinimum(0);
     numberOfErosions->setMaximum(25);
-    numberOfErosions->setValue(_numberOfErosions->text().toInt());
+    numberOfErosions->setValue(static_cast<int>(parameters.numberOfErosions));
     connect(numberOfErosions, SIGNAL(valueChanged(int)), this, SLOT(setNumberOfErosions(int)));
     layout->addWidget(new QLabel("number of erosions"), 7, 0, 1, 2);
     layout->addWidget(_numberOfErosions, 7, 2, 1, 1);
@@ -99,7 +126,7 @@ SimpleTracker::SimpleTracker(BioTracker::Core::Settings &settings)
     auto numberOfDilations = new QSlider(Qt::Horizontal);
     numberOfDilations->setMinimum(0);
     numberOfDilations->setMaximum(25);
-    numberOfDilations->setValue(_numberOfDilations->text().toInt());
+    numberOfDilations->setValue(static_cast<int>(parameters.numberOfDilations));
     connect(numberOfDilations, SIGNAL(valueChanged(int)), this, SLOT(setNumberOfDilations(int)));
     layout->addWidget(new QLabel("number of dilations"), 9, 0, 1, 2);
     layout->addWidget(_numberOfDilations, 9, 2, 1, 1);
@@ -108,7 +135,7 @@ SimpleTracker::SimpleTracker(BioTracker::Core::Settings &settings)
     auto backgroundWeight = new QSlider(Qt::Horizontal);
     backgroundWeight->setMinimum(0);
     backgroundWeight->setMaximum(100);
-    backgroundWeight->setValue(static_cast<int>(_backgroundWeight->text().toFloat() * 100));
+    backgroundWeight->setValue(static_cast<int>(parameters.backgroundWeight * 100));
     connect(backgroundWeight, SIGNAL(valueChanged(int)), this, SLOT(setBackgroundWeight(int)));
     layout->addWidget(new QLabel("Alpha"), 11, 0, 1, 2);
     layout->addWidget(_backgroundWeight, 11, 2, 1, 1);
@@ -117,7 +144,7 @@ SimpleTracker::SimpleTracker(BioTracker::Core::Settings &settings)
     auto diffThreshold = new QSlider(Qt::Horizontal);
     diffThreshold->setMinimum(0);
     diffThreshold->setMaximum(255);
-    diffThreshold->setValue(_diffThreshold->text().toInt());
+    diffThreshold->setValue(parameters.diffThreshold);
     connect(diffThreshold, SIGNAL(valueChanged(int)), this, SLOT(setDiffThreshold(int)));
     layout->addWidget(new QLabel("Threshold"), 13, 0, 1, 2);
     layout->addWidget(_diffThreshold, 13, 2, 1, 1);
@@ -126,15 +153,64 @@ SimpleTracker::SimpleTracker(BioTracker::Core::Settings &settings)
     auto framesTillPromotion = new QSlider(Qt::Horizontal);
     framesTillPromotion->setMinimum(0);
     framesTillPromotion->setMaximum(250);
-    framesTillPromotion->setValue(_framesTillPromotion->text().toInt());
+    framesTillPromotion->setValue(static_cast<int>(parameters.framesTillPromotion));
     connect(framesTillPromotion, SIGNAL(valueChanged(int)), this, SLOT(setFramesTillPromotion(int)));
     layout->addWidget(new QLabel("frames till promotion"), 15, 0, 1, 2);
     layout->addWidget(_framesTillPromotion, 15, 2, 1, 1);
     layout->addWidget(framesTillPromotion, 16, 0, 1, 3);
 
+    auto segmentationThreads = new QSlider(Qt::Horizontal);
+    segmentationThreads->setMinimum(0);
+    segmentationThreads->setMaximum(cv::getNumberOfCPUs());
+    segmentationThreads->setValue(static_cast<int>(parameters.segmentationThreads));
+    connect(segmentationThreads, SIGNAL(valueChanged(int)), this, SLOT(setSegmentationThreads(int)));
+    layout->addWidget(new QLabel("segmentation threads (0 = all)"), 17, 0, 1, 2);
+    layout->addWidget(_segmentationThreads, 17, 2, 1, 1);
+    layout->addWidget(segmentationThreads, 18, 0, 1, 3);
+
+    auto pipelinedMapping = new QCheckBox("pipelined mapping");
+    pipelinedMapping->setChecked(parameters.pipelinedMapping);
+    connect(pipelinedMapping, SIGNAL(toggled(bool)), this, SLOT(setPipelinedMapping(bool)));
+    layout->addWidget(pipelinedMapping, 19, 0, 1, 3);
+
+    auto predictiveRoi = new QCheckBox("segment around predicted positions");
+    predictiveRoi->setChecked(parameters.predictiveRoi);
+    connect(predictiveRoi, SIGNAL(toggled(bool)), this, SLOT(setPredictiveRoi(bool)));
+    layout->addWidget(predictiveRoi, 20, 0, 1, 3);
+
+    auto fullFrameInterval = new QSlider(Qt::Horizontal);
+    fullFrameInterval->setMinimum(1);
+    fullFrameInterval->setMaximum(250);
+    fullFrameInterval->setValue(static_cast<int>(parameters.fullFrameInterval));
+    connect(fullFrameInterval, SIGNAL(valueChanged(int)), this, SLOT(setFullFrameInterval(int)));
+    layout->addWidget(new QLabel("frames between full segmentations"), 21, 0, 1, 2);
+    layout->addWidget(_fullFrameInterval, 21, 2, 1, 1);
+    layout->addWidget(fullFrameInterval, 22, 0, 1, 3);
+
+    auto pyramidFactor = new QSlider(Qt::Horizontal);
+    pyramidFactor->setMinimum(1);
+    pyramidFactor->setMaximum(8);
+    pyramidFactor->setValue(static_cast<int>(parameters.pyramidFactor));
+    connect(pyramidFactor, SIGNAL(valueChanged(int)), this, SLOT(setPyramidFactor(int)));
+    layout->addWidget(new QLabel("coarse detection factor (1 = off)"), 23, 0, 1, 2);
+    layout->addWidget(_pyramidFactor, 23, 2, 1, 1);
+    layout->addWidget(pyramidFactor, 24, 0, 1, 3);
+
     auto reset = new QPushButton("reset");
     connect(reset, SIGNAL(clicked()), this, SLOT(reset()));
-    layout->addWidget(reset, 17, 0, 1, 3);
+    layout->addWidget(reset, 25, 0, 1, 3);
+
+    auto exportTrajectories = new QPushButton("export trajectories");
+    connect(exportTrajectories, SIGNAL(clicked()), this, SLOT(exportTrajectories()));
+    layout->addWidget(exportTrajectories, 26, 0, 1, 3);
+
+    auto importTrajectories = new QPushButton("import trajectories");
+    connect(importTrajectories, SIGNAL(clicked()), this, SLOT(importTrajectories()));
+    layout->addWidget(importTrajectories, 27, 0, 1, 3);
+
+    auto openJournal = new QPushButton("journal to...");
+    connect(openJournal, SIGNAL(clicked()), this, SLOT(openJournal()));
+    layout->addWidget(openJournal, 28, 0, 1, 3);
 
     ui->setLayout(layout);
 }
@@ -143,67 +219,72 @@ const TrackingAlgorithm::View SimpleTracker::ForegroundView {"Foreground"};
 const TrackingAlgorithm::View SimpleTracker::BackgroundView {"Background"};
 
 void SimpleTracker::track(size_t frameNumber, const cv::Mat &frame) {
-    if(!_backgroundInitialized || _background.rows != frame.rows || _background.cols != frame.cols){
-        _background = frame.clone();
-        cv::cvtColor(_background, _background, CV_RGB2GRAY);
-        _backgroundInitialized = true;
-    }
-    cv::Mat frameGRAY;
-    cv::cvtColor(frame, frameGRAY, CV_RGB2GRAY);
-    _background = (_background * _backgroundWeight->text().toFloat()) + (frameGRAY * (1.0f - _backgroundWeight->text().toFloat()));
-
-    _foregroundFrame = frameNumber;
-    if(_darker->isChecked()){
-        cv::subtract(_background, frameGRAY, _foreground);
-    } else if(_brighter->isChecked()){
-        cv::subtract(frameGRAY, _background, _foreground);
-    } else if(_both->isChecked()){
-        cv::absdiff(frameGRAY, _background, _foreground);
-    }
+    const TrackerParameters parameters = _parameters.snapshot();
 
-    for(size_t i = 0; i < _numberOfErosions->text().toUInt(); i++){
-        cv::erode(_foreground, _foreground, cv::Mat());
+    if(frameNumber == _lastTrackedFrame && parameters.sameSegmentation(_lastTrackedParameters)){
+        // the same frame again, e.g. shown once more while paused; its
+        // results are already there
+        QMutexLocker locker(&lastFrameLock);
+        lastFrame = frame;
+        return;
     }
-
-    for(size_t i = 0; i < _numberOfDilations->text().toUInt(); i++){
-        cv::dilate(_foreground, _foreground, cv::Mat());
+    if(_lastTrackedFrame != std::numeric_limits<size_t>::max() && frameNumber <= _lastTrackedFrame){
+        resumeTracking(frameNumber);
     }
 
-
-
-    for( int i = 0; i < _foreground.cols; i++){
-        for( int j = 0; j < _foreground.rows; j++){
-            if(_foreground.at<uchar>(cv::Point(i, j)) < _diffThreshold->text().toUInt()) {
-                _foreground.at<uchar>(cv::Point(i, j)) = 0;
-            }
-        }
+    std::shared_ptr<SegmentationResult> segmentation = _segmentations.acquire(frameNumber, parameters);
+    cv::cvtColor(frame, segmentation->frameGRAY, CV_RGB2GRAY);
+    _background.update(segmentation->frameGRAY, parameters.backgroundWeight,
+                       SegmentationEngine::resolveThreadCount(parameters.segmentationThreads));
+    // a coarse model (re-)initialized from this very frame sees no foreground yet
+    bool coarseReady = false;
+    if(parameters.pyramidFactor > 1){
+        cv::resize(segmentation->frameGRAY, _coarseFrameGRAY,
+                   SegmentationEngine::coarseSize(segmentation->frameGRAY.size(), parameters.pyramidFactor),
+                   0, 0, cv::INTER_AREA);
+        coarseReady = _coarseBackground.matches(_coarseFrameGRAY);
+        _coarseBackground.update(_coarseFrameGRAY, parameters.backgroundWeight);
+    } else if(_coarseBackground.isInitialized()){
+        _coarseBackground.reset();
     }
-
-
-    std::vector<std::vector<cv::Point>> contours;
-    cv::Mat foreground = _foreground.clone();
-    cv::findContours(foreground, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE);
-
-    cv::cvtColor(_foreground, _foreground, cv::COLOR_GRAY2RGB);
-
-    for(size_t i = 0; i < contours.size(); i++) {
-        if(contours[i].size() < _minContourSize->text().toUInt() || contours[i].size() > _maxContourSize->text().toUInt()) {
-            contours.erase(contours.begin() + i);
-            i--;
+    if(!segmentPredicted(frameNumber, parameters, *segmentation)){
+        // the coarse level can miss small or thin objects, so it also falls
+        // back to the full frame now and then
+        if(fullFrameDue(frameNumber, parameters) || !coarseReady || !segmentCoarseToFine(parameters, *segmentation)){
+            segment(parameters, *segmentation);
+            _lastFullFrame = frameNumber;
         }
     }
+    _segmentations.insert(segmentation);
+    // Now we know the centers of all the detected blobs in the picture (center)
 
-    _ellipses = std::vector<cv::RotatedRect>(contours.size());
-
-    _ellipsesFrame = frameNumber;
-    for(size_t i = 0; i < contours.size(); i++) {
-        _ellipses[i] = cv::fitEllipse(cv::Mat(contours[i]));
+    // TRACKING
+    MappingPipeline::Job job;
+    job.frame = frameNumber;
+    job.ellipses = segmentation->ellipses;
+    job.parameters = parameters;
+    if(parameters.pipelinedMapping){
+        // m_trackedObjects still ends at an earlier frame when track() returns;
+        // this frame's poses appear once the worker gets to it. A failed
+        // mapping is rethrown here with the next frame.
+        _pipeline.submit(std::move(job));
+    } else {
+        // mapping must not overtake frames still queued from pipelined mode
+        _pipeline.drain();
+        mapFrame(job);
     }
-    // Now we know the centers of all the detected contours in the picture (center)
 
-    // TRACKING
-    std::vector<cv::RotatedRect> ellipses = _ellipses;
-    _mapper->map(ellipses, frameNumber);
+    if(_snapshots.due(frameNumber, parameters.snapshotInterval)){
+        // the snapshot needs the mapping of this very frame
+        _pipeline.drain();
+        std::lock_guard<std::mutex> lock(_mappingLock);
+        TrackingSnapshots::Snapshot &snapshot = _snapshots.add(frameNumber);
+        snapshot.background = _background.accumulator().clone();
+        snapshot.coarseBackground = _coarseBackground.accumulator().clone();
+        _mapper->saveState(frameNumber, snapshot.mapping);
+    }
+    _lastTrackedFrame = frameNumber;
+    _lastTrackedParameters = parameters;
 
     {
         QMutexLocker locker(&lastFrameLock);
@@ -216,45 +297,24 @@ void SimpleTracker::paint (size_t frameNumber, BioTracker::Core::ProxyMat & p, c
         QMutexLocker locker(&lastFrameLock);
         lastFrame = p.getMat();
     }
-    if(!_backgroundInitialized || _background.rows != p.getMat().rows || _background.cols != p.getMat().cols){
-        _background = p.getMat();
-        cv::cvtColor(_background, _background, CV_RGB2GRAY);
-        _backgroundInitialized = true;
+    if(!_background.isInitialized() || _background.accumulator().size() != p.getMat().size()){
+        cv::Mat frameGRAY;
+        cv::cvtColor(p.getMat(), frameGRAY, CV_RGB2GRAY);
+        _background.initialize(frameGRAY);
     }
     if(view.name == SimpleTracker::ForegroundView.name) {
-        if(_foregroundFrame != frameNumber){
-            cv::Mat frameGRAY;
-            cv::cvtColor(p.getMat(), frameGRAY, CV_RGB2GRAY);
-
-            if(_darker->isChecked()){
-                cv::subtract(_background, frameGRAY, _foreground);
-            } else if(_brighter->isChecked()){
-                cv::subtract(frameGRAY, _background, _foreground);
-            } else if(_both->isChecked()){
-                cv::absdiff(frameGRAY, _background, _foreground);
-            }
-
-            for(size_t i = 0; i < _numberOfErosions->text().toUInt(); i++){
-                cv::erode(_foreground, _foreground, cv::Mat());
-            }
-
-            for(size_t i = 0; i < _numberOfDilations->text().toUInt(); i++){
-                cv::dilate(_foreground, _foreground, cv::Mat());
-            }
-
-            for( int i = 0; i < _foreground.cols; i++){
-                for( int j = 0; j < _foreground.rows; j++){
-                    if(_foreground.at<uchar>(cv::Point(i, j)) < _diffThreshold->text().toUInt()) {
-                        _foreground.at<uchar>(cv::Point(i, j)) = 0;
-                    }
-                }
-            }
-            cv::cvtColor(_foreground, _foreground, cv::COLOR_GRAY2RGB);
+        const TrackerParameters parameters = _parameters.snapshot();
+        std::shared_ptr<SegmentationResult> segmentation = _segmentations.find(frameNumber, parameters);
+        if(!segmentation){
+            segmentation = _segmentations.acquire(frameNumber, parameters);
+            cv::cvtColor(p.getMat(), segmentation->frameGRAY, CV_RGB2GRAY);
+            segment(parameters, *segmentation);
+            _segmentations.insert(segmentation);
         }
 
-        p.setMat(_foreground);
+        p.setMat(segmentation->foregroundRGB());
     } else if(view.name == SimpleTracker::BackgroundView.name) {
-        p.setMat(_background);
+        p.setMat(_background.view());
     } else {
         auto &image = p.getMat();
         {
@@ -267,30 +327,14 @@ void SimpleTracker::paint (size_t frameNumber, BioTracker::Core::ProxyMat & p, c
 
 void SimpleTracker::paintOverlay(size_t frame, QPainter *painter, const View &view) {
     if(view.name == SimpleTracker::ForegroundView.name) {
-        if(_ellipsesFrame != frame){
-			std::vector<std::vector<cv::Point>> contours;
-			cv::Mat foreground = _foreground.clone();
-
-			cv::cvtColor(foreground, foreground, cv::COLOR_RGB2GRAY);
-            cv::findContours(foreground, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE);
-
-            for(size_t i = 0; i < contours.size(); i++) {
-                if(contours[i].size() < _minContourSize->text().toUInt() || contours[i].size() > _maxContourSize->text().toUInt()) {
-                    contours.erase(contours.begin() + i);
-                    i--;
-                }
-            }
-
-            _ellipses = std::vector<cv::RotatedRect>(contours.size());
-
-            _ellipsesFrame = frame;
-            for(size_t i = 0; i < contours.size(); i++) {
-                _ellipses[i] = cv::fitEllipse(cv::Mat(contours[i]));
-            }
+        std::shared_ptr<SegmentationResult> segmentation = _segmentations.find(frame, _parameters.snapshot());
+        if(!segmentation){
+            return;
         }
+        const std::vector<cv::RotatedRect> &ellipses = segmentation->ellipses;
 
-        for( size_t i = 0; i < _ellipses.size(); i++){
-            cv::RotatedRect ellipse = _ellipses.at(i);
+        for( size_t i = 0; i < ellipses.size(); i++){
+            cv::RotatedRect ellipse = ellipses.at(i);
             painter->setPen(QPen(QColor(0, 0, 255), 3));
             painter->translate(ellipse.center.x, ellipse.center.y);
             painter->rotate(ellipse.angle);
@@ -310,9 +354,19 @@ void SimpleTracker::postConnect() {
 }
 
 
-void SimpleTracker::prepareSave() { }
+void SimpleTracker::prepareSave() {
+    _pipeline.drain();
+    // the whole history is saved, including what was moved to disk; the
+    // next frame archives it again
+    std::lock_guard<std::mutex> lock(_mappingLock);
+    _mapper->restoreArchivedPoses();
+}
 
-void SimpleTracker::postLoad() { }
+void SimpleTracker::postLoad() {
+    // the loaded tracks replace the ones the mapper has derived state for
+    std::lock_guard<std::mutex> lock(_mappingLock);
+    _mapper->invalidateTrackCaches();
+}
 
 void SimpleTracker::inputChanged() {
     resetTracks();
@@ -321,13 +375,12 @@ void SimpleTracker::inputChanged() {
 //=============== H E L P E R S ================
 
 void SimpleTracker::paintTrackedFishes(QPainter *painter, size_t frame){
+    std::lock_guard<std::mutex> lock(_mappingLock);
     for( size_t i = 0; i < m_trackedObjects.size(); i++){
 //        for (BioTracker::Core::TrackedObject& trackedObject : m_trackedObjects) {
         TrackedFish& trackedFish = static_cast<TrackedFish&>(m_trackedObjects.at(i));
-        std::shared_ptr<FishPose> fish;
-        if(trackedFish.hasValuesAtFrame(frame)){
-            fish = trackedFish.get<FishPose>(frame);
-        } else {
+        std::shared_ptr<FishPose> fish = _mapper->getPose(i, frame);
+        if(!fish){
             continue;
         }
         cv::Scalar color = fish->associated_color();
@@ -372,9 +425,116 @@ void SimpleTracker::paintTrackedFishes(QPainter *painter, size_t frame){
 }
 
 void SimpleTracker::resetTracks(){
+    const TrackerParameters parameters = _parameters.snapshot();
+    // frames still queued belong to the old input
+    _pipeline.clear();
+    std::lock_guard<std::mutex> lock(_mappingLock);
     m_trackedObjects.clear();
-    _backgroundInitialized = false;
-    _mapper = new Mapper(m_trackedObjects, _numberOfObjects, _framesTillPromotion->text().toUInt());
+    _background.reset();
+    _coarseBackground.reset();
+    _segmentations.clear();
+    _lastFullFrame = std::numeric_limits<size_t>::max();
+    _lastTrackedFrame = std::numeric_limits<size_t>::max();
+    _snapshots.clear();
+    _mapper.reset(new Mapper(m_trackedObjects, parameters.numberOfObjects, parameters.framesTillPromotion,
+                             parameters.candidateCapacity));
+    _mapper->setJournal(&_journal);
+    _journal.reset();
+}
+
+void SimpleTracker::resumeTracking(size_t frame){
+    // queued frames before frame are kept, the mapper cuts off the rest
+    _pipeline.drain();
+    std::lock_guard<std::mutex> lock(_mappingLock);
+    _segmentations.clear();
+    _lastFullFrame = std::numeric_limits<size_t>::max();
+    const TrackingSnapshots::Snapshot *snapshot = _snapshots.before(frame);
+    if(snapshot){
+        _background.restore(snapshot->background);
+        _coarseBackground.restore(snapshot->coarseBackground);
+        _mapper->restoreState(snapshot->mapping, frame);
+        _snapshots.discardFrom(snapshot->frame + 1);
+    } else {
+        // no saved state that early: the tracks still keep their poses
+        // before frame, only the background is learned again
+        _background.reset();
+        _coarseBackground.reset();
+        _mapper->rewind(frame);
+        _snapshots.clear();
+    }
+    // frame 0 leaves nothing tracked, which is size_t max as well
+    _lastTrackedFrame = frame - 1;
+}
+
+void SimpleTracker::mapFrame(MappingPipeline::Job &job){
+    std::lock_guard<std::mutex> lock(_mappingLock);
+    applyMappingParameters(job.parameters);
+    _mapper->map(job.ellipses, job.frame);
+}
+
+void SimpleTracker::applyMappingParameters(const TrackerParameters &parameters){
+    _mapper->setNumberOfObjects(parameters.numberOfObjects);
+    _mapper->setFramesTillPromotion(parameters.framesTillPromotion);
+    _mapper->setCandidateCapacity(parameters.candidateCapacity);
+    _mapper->setRetentionWindow(parameters.retentionWindow);
+    _mapper->setArchiveSpill(parameters.spillArchive);
+    const float averageSpeedPx = parameters.averageSpeedPx;
+    FishPose::_averageSpeed = averageSpeedPx;
+    FishPose::_averageSpeedSigma = std::sqrt(-(averageSpeedPx*averageSpeedPx/2) * (1/std::log(0.33f)));
+}
+
+void SimpleTracker::segment(const TrackerParameters &parameters, SegmentationResult &segmentation){
+    // paint() may segment a frame that was not tracked yet, possibly from another thread
+    std::lock_guard<std::mutex> lock(_segmentationLock);
+    _segmentation.setThreadCount(parameters.segmentationThreads);
+    _segmentation.segment(_background.view(), segmentation.frameGRAY, parameters,
+                          segmentation.foreground, segmentation.ellipses);
+}
+
+bool SimpleTracker::segmentPredicted(size_t frame, const TrackerParameters &parameters, SegmentationResult &segmentation){
+    // pipelined mapping may not have finished the previous frame, so there is
+    // nothing to predict from
+    if(!parameters.predictiveRoi || parameters.pipelinedMapping){
+        return false;
+    }
+    if(fullFrameDue(frame, parameters)){
+        return false;
+    }
+
+    // frames queued before pipelining was switched off
+    _pipeline.drain();
+    std::vector<cv::Rect> windows;
+    {
+        std::lock_guard<std::mutex> lock(_mappingLock);
+        applyMappingParameters(parameters);
+        if(!_mapper->predictSearchWindows(frame, segmentation.frameGRAY.size(), windows)){
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_segmentationLock);
+    _segmentation.setThreadCount(parameters.segmentationThreads);
+    const bool complete = _segmentation.segmentWindows(_background.view(), segmentation.frameGRAY, parameters, windows,
+                                                       segmentation.foreground, segmentation.ellipses);
+    // a lost object or a blob cut by a window border needs the full frame
+    return complete && segmentation.ellipses.size() >= parameters.numberOfObjects;
+}
+
+bool SimpleTracker::segmentCoarseToFine(const TrackerParameters &parameters, SegmentationResult &segmentation){
+    std::lock_guard<std::mutex> lock(_segmentationLock);
+    _segmentation.setThreadCount(parameters.segmentationThreads);
+    const bool complete = _segmentation.segmentCoarseToFine(_coarseBackground.view(), _coarseFrameGRAY,
+                                                            _background.view(), segmentation.frameGRAY, parameters,
+                                                            segmentation.foreground, segmentation.ellipses);
+    // an object the coarse level missed or a blob cut by a refinement window
+    // needs the full frame
+    return complete && segmentation.ellipses.size() >= parameters.numberOfObjects;
+}
+
+bool SimpleTracker::fullFrameDue(size_t frame, const TrackerParameters &parameters) const{
+    // a full frame now and then picks up objects that every window missed
+    return _lastFullFrame == std::numeric_limits<size_t>::max() || frame <= _lastFullFrame ||
+           frame - _lastFullFrame >= parameters.fullFrameInterval;
 }
 
 // =========== I O = H A N D L I N G ============
@@ -399,54 +559,179 @@ void SimpleTracker::mouseWheelEvent(QWheelEvent *) { }
 // =============== S L O T S =====================
 
 void SimpleTracker::setNumberOfObjects(const QString &newValue){
-    _numberOfObjects = newValue.toUInt();
-    _mapper->setNumberOfObjects(newValue.toUInt());
+    const size_t value = newValue.toUInt();
+    _parameters.update([value](TrackerParameters &p) { p.numberOfObjects = value; });
 }
 
 void SimpleTracker::setAverageSpeedPx(const QString &newValue){
-    _averageSpeedPx = newValue.toFloat();
-    FishPose::_averageSpeed = _averageSpeedPx;
-    FishPose::_averageSpeedSigma = std::sqrt(-(_averageSpeedPx*_averageSpeedPx/2) * (1/std::log(0.33f)));
+    const float value = newValue.toFloat();
+    _parameters.update([value](TrackerParameters &p) { p.averageSpeedPx = value; });
 }
 
-void SimpleTracker::setMinContourSize(int newValue){
-    _minContourSize->setText(QString::number(newValue));
+void SimpleTracker::setMinBlobArea(int newValue){
+    _minBlobArea->setText(QString::number(newValue));
+    _parameters.update([newValue](TrackerParameters &p) { p.minBlobArea = static_cast<size_t>(newValue); });
     Q_EMIT update();
 }
 
-void SimpleTracker::setMaxContourSize(int newValue){
-    _maxContourSize->setText(QString::number(newValue));
+void SimpleTracker::setMaxBlobArea(int newValue){
+    _maxBlobArea->setText(QString::number(newValue));
+    _parameters.update([newValue](TrackerParameters &p) { p.maxBlobArea = static_cast<size_t>(newValue); });
     Q_EMIT update();
 }
 
 void SimpleTracker::setNumberOfErosions(int newValue){
     _numberOfErosions->setText(QString::number(newValue));
+    _parameters.update([newValue](TrackerParameters &p) { p.numberOfErosions = static_cast<size_t>(newValue); });
     Q_EMIT update();
 }
 
 void SimpleTracker::setNumberOfDilations(int newValue){
     _numberOfDilations->setText(QString::number(newValue));
+    _parameters.update([newValue](TrackerParameters &p) { p.numberOfDilations = static_cast<size_t>(newValue); });
     Q_EMIT update();
 }
 
 void SimpleTracker::setDiffThreshold(int newValue){
     _diffThreshold->setText(QString::number(newValue));
+    _parameters.update([newValue](TrackerParameters &p) { p.diffThreshold = cv::saturate_cast<uchar>(newValue); });
     Q_EMIT update();
 }
 
 void SimpleTracker::setFramesTillPromotion(int newValue){
     _framesTillPromotion->setText(QString::number(newValue));
-    _mapper->setFramesTillPromotion(static_cast<size_t>(newValue));
+    _parameters.update([newValue](TrackerParameters &p) { p.framesTillPromotion = static_cast<size_t>(newValue); });
     Q_EMIT update();
 }
 
 void SimpleTracker::setBackgroundWeight(int newValue){
     float val = static_cast<float>(newValue) / 100.0f;
     _backgroundWeight->setText(QString::number(val));
+    _parameters.update([val](TrackerParameters &p) { p.backgroundWeight = val; });
+    Q_EMIT update();
+}
+
+void SimpleTracker::setSegmentationThreads(int newValue){
+    _segmentationThreads->setText(QString::number(newValue));
+    _parameters.update([newValue](TrackerParameters &p) { p.segmentationThreads = static_cast<size_t>(newValue); });
+    Q_EMIT update();
+}
+
+void SimpleTracker::setPipelinedMapping(bool enabled){
+    _parameters.update([enabled](TrackerParameters &p) { p.pipelinedMapping = enabled; });
+    Q_EMIT update();
+}
+
+void SimpleTracker::setPredictiveRoi(bool enabled){
+    _parameters.update([enabled](TrackerParameters &p) { p.predictiveRoi = enabled; });
+    Q_EMIT update();
+}
+
+void SimpleTracker::setFullFrameInterval(int newValue){
+    _fullFrameInterval->setText(QString::number(newValue));
+    _parameters.update([newValue](TrackerParameters &p) { p.fullFrameInterval = static_cast<size_t>(newValue); });
+    Q_EMIT update();
+}
+
+void SimpleTracker::setPyramidFactor(int newValue){
+    _pyramidFactor->setText(QString::number(newValue));
+    _parameters.update([newValue](TrackerParameters &p) { p.pyramidFactor = static_cast<size_t>(newValue); });
+    Q_EMIT update();
+}
+
+void SimpleTracker::setPolarity(){
+    ForegroundExtractor::Polarity polarity = ForegroundExtractor::Darker;
+    if(_brighter->isChecked()){
+        polarity = ForegroundExtractor::Brighter;
+    } else if(_both->isChecked()){
+        polarity = ForegroundExtractor::Both;
+    }
+    _parameters.update([polarity](TrackerParameters &p) { p.polarity = polarity; });
     Q_EMIT update();
 }
 
 void SimpleTracker::reset(){
     resetTracks();
     Q_EMIT update();
+}
+
+void SimpleTracker::exportTrajectories(){
+    const QString path = QFileDialog::getSaveFileName(getToolsWidget(), "export trajectories", QString(),
+                                                      "binary trajectories (*.trajectories);;JSON (*.json)");
+    if (path.isEmpty()) {
+        return;
+    }
+    _pipeline.drain();
+    bool written;
+    {
+        std::lock_guard<std::mutex> lock(_mappingLock);
+        _mapper->restoreArchivedPoses();
+        if (path.endsWith(".json", Qt::CaseInsensitive)) {
+            written = TrajectoryFile::writeJson(path, m_trackedObjects);
+        } else {
+            written = TrajectoryFile::write(path, m_trackedObjects);
+        }
+        _mapper->archiveRestoredPoses();
+    }
+    if (!written) {
+        QMessageBox::warning(getToolsWidget(), "export trajectories", "Could not write " + path + ".");
+    }
+}
+
+void SimpleTracker::importTrajectories(){
+    const QString path = QFileDialog::getOpenFileName(getToolsWidget(), "import trajectories", QString(),
+                                                      "binary trajectories (*.trajectories);;JSON (*.json)");
+    if (path.isEmpty()) {
+        return;
+    }
+    std::vector<TrackedObject> objects;
+    bool read;
+    if (path.endsWith(".json", Qt::CaseInsensitive)) {
+        read = TrajectoryFile::readJson(path, objects);
+    } else {
+        TrajectoryFile file;
+        read = file.open(path) && file.read(objects);
+    }
+    if (!read) {
+        // the tracks stay as they are
+        QMessageBox::warning(getToolsWidget(), "import trajectories", "Could not read " + path + ".");
+        return;
+    }
+    _pipeline.clear();
+    {
+        std::lock_guard<std::mutex> lock(_mappingLock);
+        m_trackedObjects = std::move(objects);
+        _mapper->invalidateTrackCaches();
+    }
+    Q_EMIT update();
+}
+
+void SimpleTracker::openJournal(){
+    QString path = QFileDialog::getSaveFileName(getToolsWidget(), "journal to", QString(), "journal (*.journal)",
+                                                nullptr, QFileDialog::DontConfirmOverwrite);
+    if (path.isEmpty()) {
+        return;
+    }
+    if (path.endsWith(".journal", Qt::CaseInsensitive)) {
+        path.chop(static_cast<int>(qstrlen(".journal")));
+    }
+    // the mapping stage feeds the journal, it must not run while the journal is reopened
+    _pipeline.drain();
+    std::vector<TrackedObject> recovered;
+    bool opened;
+    {
+        std::lock_guard<std::mutex> lock(_mappingLock);
+        opened = _journal.open(path, recovered);
+        // an existing journal holds the session to continue, a new one
+        // starts with the poses mapped from now on
+        if (opened && !recovered.empty()) {
+            m_trackedObjects = std::move(recovered);
+            _mapper->invalidateTrackCaches();
+        }
+    }
+    if (!opened) {
+        QMessageBox::warning(getToolsWidget(), "journal", "Could not open the journal at " + path + ".");
+        return;
+    }
+    Q_EMIT update();
 }
\ No newline at end of file
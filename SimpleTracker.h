@@ -9,6 +9,13 @@
 #include "FishPose.h"
 #include "FishCandidate.h"
 #include "Mapper.h"
+#include "ForegroundExtractor.h"
+#include "TrackerParameters.h"
+#include "BackgroundModel.h"
+#include "SegmentationCache.h"
+#include "SegmentationEngine.h"
+#include "MappingPipeline.h"
+#include "TrackingSnapshots.h"
 
 #include <opencv2/opencv.hpp>
 
@@ -41,46 +48,78 @@ public:
 private:
     void paintTrackedFishes(QPainter *painter, size_t frame);
     void resetTracks();
-
-    bool                        _backgroundInitialized;
-    cv::Mat                     _background;
-    size_t                      _numberOfObjects;
+    // goes back to just before frame, the tracks keep their poses up to there;
+    // candidates and background come from the latest snapshot before frame
+    void resumeTracking(size_t frame);
+    void applyMappingParameters(const TrackerParameters &parameters);
+    void mapFrame(MappingPipeline::Job &job);
+    void segment(const TrackerParameters &parameters, SegmentationResult &segmentation);
+    bool segmentPredicted(size_t frame, const TrackerParameters &parameters, SegmentationResult &segmentation);
+    bool segmentCoarseToFine(const TrackerParameters &parameters, SegmentationResult &segmentation);
+    bool fullFrameDue(size_t frame, const TrackerParameters &parameters) const;
+
+    TrackerParameterStore       _parameters;
+
+    BackgroundModel             _background;
+    // downsampled level for the coarse-to-fine mode, only touched by track()
+    BackgroundModel             _coarseBackground;
+    cv::Mat                     _coarseFrameGRAY;
 
 	QMutex  lastFrameLock;
 	cv::Mat lastFrame;
 
-    size_t _ellipsesFrame;
-    std::vector<cv::RotatedRect> _ellipses;
-
-    size_t _foregroundFrame;
-    cv::Mat _foreground;
+    SegmentationCache _segmentations;
+    std::mutex        _segmentationLock;
+    SegmentationEngine _segmentation;
+    // last frame segmented in full, the window modes fall back to it periodically
+    size_t            _lastFullFrame;
+    // last frame passed to track(), going back to an earlier one resumes from a snapshot
+    size_t            _lastTrackedFrame;
+    // parameters it was tracked with, changed ones track it again
+    TrackerParameters _lastTrackedParameters;
+    TrackingSnapshots _snapshots;
 
-    float    _averageSpeedPx;
-	enum { Darker = 0, Brighter = 1, Both = 2 };
     QRadioButton * _darker;
     QRadioButton * _brighter;
     QRadioButton * _both;
 
 
-    QLabel *    _minContourSize;
-    QLabel *    _maxContourSize;
+    QLabel *    _minBlobArea;
+    QLabel *    _maxBlobArea;
     QLabel *    _numberOfErosions;
     QLabel *    _numberOfDilations;
     QLabel *    _backgroundWeight;
     QLabel *    _diffThreshold;
 	QLabel *    _framesTillPromotion;
+    QLabel *    _segmentationThreads;
+    QLabel *    _fullFrameInterval;
+    QLabel *    _pyramidFactor;
 
-    Mapper *					_mapper;
+    std::unique_ptr<Mapper>     _mapper;
+    // guards _mapper and m_trackedObjects against the mapping stage
+    std::mutex                  _mappingLock;
+    // fed by _mapper, has to outlive the mapping stage
+    PoseJournal                 _journal;
+    MappingPipeline             _pipeline;
 
 private Q_SLOTS:
     void setNumberOfObjects(const QString &newValue);
     void setAverageSpeedPx(const QString &newValue);
-    void setMinContourSize(int newValue);
-    void setMaxContourSize(int newValue);
+    void setMinBlobArea(int newValue);
+    void setMaxBlobArea(int newValue);
     void setNumberOfErosions(int newValue);
     void setNumberOfDilations(int newValue);
     void setBackgroundWeight(int newValue);
     void setDiffThreshold(int newValue);
 	void setFramesTillPromotion(int newValue);
+    void setSegmentationThreads(int newValue);
+    void setPipelinedMapping(bool enabled);
+    void setPredictiveRoi(bool enabled);
+    void setFullFrameInterval(int newValue);
+    void setPyramidFactor(int newValue);
+    void setPolarity();
     void reset();
+    void exportTrajectories();
+    void importTrajectories();
+    void openJournal();
 };
@@ -0,0 +1,107 @@
+#include "SpatialGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+SpatialGrid::SpatialGrid()
+    : _cellSize(1.0f)
+    , _columns(0)
+    , _rows(0)
+{}
+
+void SpatialGrid::build(const std::vector<cv::RotatedRect> &ellipses, float cellSize) {
+    _points.resize(ellipses.size());
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest();
+    float maxY = std::numeric_limits<float>::lowest();
+    size_t finite = 0;
+    for (size_t i = 0; i < ellipses.size(); i++) {
+        const cv::Point2f &center = ellipses[i].center;
+        _points[i] = center;
+        if (!std::isfinite(center.x) || !std::isfinite(center.y)) {
+            continue;
+        }
+        minX = std::min(minX, center.x);
+        minY = std::min(minY, center.y);
+        maxX = std::max(maxX, center.x);
+        maxY = std::max(maxY, center.y);
+        finite++;
+    }
+    if (finite == 0) {
+        _columns = 0;
+        _rows = 0;
+        _cellStart.assign(1, 0);
+        _entries.clear();
+        return;
+    }
+
+    // keep the cell count in proportion to the points, whatever the radius
+    const float extent = std::max(maxX - minX, maxY - minY);
+    const float minimumCellSize = extent / std::sqrt(4.0f * static_cast<float>(finite)) + 1e-3f;
+    _cellSize = std::isfinite(cellSize) ? std::max(cellSize, minimumCellSize) : extent + 1.0f;
+    _origin = cv::Point2f(minX, minY);
+    _columns = static_cast<int>((maxX - minX) / _cellSize) + 1;
+    _rows = static_cast<int>((maxY - minY) / _cellSize) + 1;
+
+    // counting sort of the point indices by cell
+    const size_t cells = static_cast<size_t>(_columns) * static_cast<size_t>(_rows);
+    _cellStart.assign(cells + 1, 0);
+    std::vector<size_t> cellOfPoint(_points.size(), cells);
+    for (size_t i = 0; i < _points.size(); i++) {
+        if (!std::isfinite(_points[i].x) || !std::isfinite(_points[i].y)) {
+            continue;
+        }
+        cellOfPoint[i] = static_cast<size_t>(cellOf(_points[i].y, _origin.y, _rows)) * static_cast<size_t>(_columns)
+                         + static_cast<size_t>(cellOf(_points[i].x, _origin.x, _columns));
+        _cellStart[cellOfPoint[i] + 1]++;
+    }
+    for (size_t c = 0; c < cells; c++) {
+        _cellStart[c + 1] += _cellStart[c];
+    }
+    _entries.resize(finite);
+    std::vector<size_t> fill(_cellStart.begin(), _cellStart.end() - 1);
+    for (size_t i = 0; i < _points.size(); i++) {
+        if (cellOfPoint[i] < cells) {
+            _entries[fill[cellOfPoint[i]]++] = i;
+        }
+    }
+}
+
+void SpatialGrid::query(const cv::Point2f &point, float radius, std::vector<size_t> &indices) const {
+    indices.clear();
+    if (_columns == 0 || !std::isfinite(point.x) || !std::isfinite(point.y) || !(radius >= 0)) {
+        return;
+    }
+
+    const int left = cellOf(point.x - radius, _origin.x, _columns);
+    const int right = cellOf(point.x + radius, _origin.x, _columns);
+    const int top = cellOf(point.y - radius, _origin.y, _rows);
+    const int bottom = cellOf(point.y + radius, _origin.y, _rows);
+
+    // a little slack, the exact gate is left to the caller
+    const double reach = static_cast<double>(radius) * (1.0 + 1e-4) + 1e-3;
+    for (int y = top; y <= bottom; y++) {
+        const size_t row = static_cast<size_t>(y) * static_cast<size_t>(_columns);
+        for (size_t e = _cellStart[row + static_cast<size_t>(left)]; e < _cellStart[row + static_cast<size_t>(right) + 1]; e++) {
+            const size_t i = _entries[e];
+            const double dx = static_cast<double>(_points[i].x) - point.x;
+            const double dy = static_cast<double>(_points[i].y) - point.y;
+            if (dx * dx + dy * dy <= reach * reach) {
+                indices.push_back(i);
+            }
+        }
+    }
+    std::sort(indices.begin(), indices.end());
+}
+
+// ================ P R I V A T E ===================
+
+int SpatialGrid::cellOf(float coordinate, float origin, int cells) const {
+    const float cell = std::floor((coordinate - origin) / _cellSize);
+    if (!(cell >= 0)) {
+        return 0;
+    }
+    return cell >= static_cast<float>(cells - 1) ? cells - 1 : static_cast<int>(cell);
+}
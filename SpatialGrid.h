@@ -0,0 +1,32 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <opencv2/opencv.hpp>
+
+// Uniform grid over a set of points (contour centers), rebuilt once per frame.
+// With the cell size at the gating radius a lookup touches only the 3x3
+// neighbouring cells, so gating all tracks is linear in tracks + contours.
+class SpatialGrid {
+public:
+    SpatialGrid();
+
+    // points that are not finite are never returned
+    void build(const std::vector<cv::RotatedRect> &ellipses, float cellSize);
+
+    // indices of all centers within radius of point, in ascending order
+    void query(const cv::Point2f &point, float radius, std::vector<size_t> &indices) const;
+
+private:
+    int cellOf(float coordinate, float origin, int cells) const;
+
+    cv::Point2f         _origin;
+    float               _cellSize;
+    int                 _columns;
+    int                 _rows;
+    std::vector<cv::Point2f> _points;
+    // entries of cell c are _entries[_cellStart[c] .. _cellStart[c + 1])
+    std::vector<size_t> _cellStart;
+    std::vector<size_t> _entries;
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "TrackStatistics.h"
+
+#include <cmath>
+
+using namespace BioTracker::Core;
+
+const size_t TrackStatistics::SpeedWindow;
+const float TrackStatistics::OrientationFalloff = 0.9f;
+const float TrackStatistics::OrientationFalloffMargin = 0.4f;
+
+TrackStatistics::TrackStatistics()
+    : _valid(false)
+    , _id(0)
+    , _coveredFrom(0)
+    , _newest(0)
+    , _count(0)
+    , _orientationKnown(false)
+    , _weightSum(0.0f)
+    , _speedKnown(false)
+    , _speedSum(0.0f)
+{}
+
+void TrackStatistics::clear() {
+    _valid = false;
+    _count = 0;
+}
+
+void TrackStatistics::start(size_t id) {
+    _valid = true;
+    _id = id;
+    _coveredFrom = 0;
+    _count = 0;
+}
+
+void TrackStatistics::load(TrackedObject &object, size_t frame) {
+    size_t frames[Capacity];
+    size_t found = 0;
+    const size_t lowest = frame > LoadWindow ? frame - LoadWindow : 0;
+    size_t scanned = frame + 1;
+    while (scanned > lowest && found < Capacity) {
+        scanned--;
+        if (object.hasValuesAtFrame(scanned)) {
+            frames[found++] = scanned;
+        }
+    }
+
+    _valid = true;
+    _id = object.getId();
+    // a full cache stops at its oldest pose, anything before is unknown
+    _coveredFrom = scanned;
+    _count = found;
+    for (size_t k = 0; k < found; k++) {
+        Entry &slot = _entries[found - 1 - k];
+        slot.frame = frames[k];
+        slot.pose = *object.get<FishPose>(frames[k]);
+    }
+    _newest = found > 0 ? found - 1 : 0;
+    summarize();
+}
+
+void TrackStatistics::add(size_t id, size_t frame, const FishPose &pose) {
+    if (!_valid || id != _id) {
+        _valid = true;
+        _id = id;
+        _coveredFrom = frame;
+        _count = 0;
+    } else if (_count > 0 && frame <= entry(0).frame) {
+        _coveredFrom = frame;
+        _count = 0;
+    }
+
+    if (_count == Capacity) {
+        _coveredFrom = entry(Capacity - 1).frame + 1;
+    } else {
+        _count++;
+    }
+    _newest = (_newest + 1) % Capacity;
+    _entries[_newest].frame = frame;
+    _entries[_newest].pose = pose;
+    summarize();
+}
+
+bool TrackStatistics::current(size_t id, size_t frame) const {
+    return _valid && id == _id && _count > 0 && entry(0).frame == frame;
+}
+
+TrackStatistics::Lookup TrackStatistics::at(size_t id, size_t frame, const FishPose *&pose) const {
+    if (!_valid || id != _id || _count == 0 || frame > entry(0).frame || frame < _coveredFrom) {
+        return Unknown;
+    }
+    for (size_t age = 0; age < _count; age++) {
+        const Entry &candidate = entry(age);
+        if (candidate.frame == frame) {
+            pose = &candidate.pose;
+            return Found;
+        }
+        if (candidate.frame < frame) {
+            break;
+        }
+    }
+    return Absent;
+}
+
+TrackStatistics::Lookup TrackStatistics::before(size_t id, size_t frame, size_t &poseFrame, const FishPose *&pose) const {
+    if (!_valid || id != _id || _count == 0 || frame > entry(0).frame + 1) {
+        return Unknown;
+    }
+    if (frame == 0) {
+        return Absent;
+    }
+    for (size_t age = 0; age < _count; age++) {
+        const Entry &candidate = entry(age);
+        if (candidate.frame < frame) {
+            poseFrame = candidate.frame;
+            pose = &candidate.pose;
+            return Found;
+        }
+    }
+    // nothing retained before frame; only a cache holding the whole track knows there is nothing at all
+    return _coveredFrom == 0 ? Absent : Unknown;
+}
+
+bool TrackStatistics::orientationSums(size_t id, size_t frame, cv::Point2f &derivative, float &weightSum) const {
+    if (!current(id, frame) || !_orientationKnown) {
+        return false;
+    }
+    derivative = _derivative;
+    weightSum = _weightSum;
+    return true;
+}
+
+bool TrackStatistics::speedSum(size_t id, size_t frame, float &sum) const {
+    if (!current(id, frame) || !_speedKnown) {
+        return false;
+    }
+    sum = _speedSum;
+    return true;
+}
+
+// ================ P R I V A T E ===================
+
+const TrackStatistics::Entry &TrackStatistics::entry(size_t age) const {
+    return _entries[(_newest + Capacity - age) % Capacity];
+}
+
+// The loops of estimateOrientationRad and getCurrentSpeed over the cached
+// poses, with the same operations in the same order so the sums are
+// bit-identical. Both stop after a few entries, so this is O(1) per pose.
+void TrackStatistics::summarize() {
+    _orientationKnown = false;
+    _speedKnown = false;
+    if (_count == 0) {
+        return;
+    }
+
+    cv::Point2f nextPoint = entry(0).pose.last_known_position().center;
+    _derivative = cv::Point2f(0.0f, 0.0f);
+    _weightSum = 0.0f;
+    float currentWeight = 1.0f;
+    size_t age = 0;
+    for (;;) {
+        if (age + 1 == _count) {
+            // the walk ends for good only if the track has no earlier pose
+            _orientationKnown = _coveredFrom == 0;
+            break;
+        }
+        const cv::Point2f currentPoint = entry(age + 1).pose.last_known_position().center;
+        const cv::Point2f oneStepDerivative = nextPoint - currentPoint;
+
+        _derivative += currentWeight * oneStepDerivative;
+        _weightSum += currentWeight;
+
+        currentWeight *= OrientationFalloff;
+        if (currentWeight < OrientationFalloffMargin) {
+            _orientationKnown = true;
+            break;
+        }
+
+        nextPoint = currentPoint;
+        age++;
+    }
+
+    if (_count <= SpeedWindow) {
+        return;
+    }
+    _speedSum = 0.0f;
+    for (age = 0; age < SpeedWindow; age++) {
+        const Entry &next = entry(age);
+        const Entry &current = entry(age + 1);
+        if (current.frame + 1 != next.frame) {
+            return;
+        }
+        const cv::Point2f derivation = current.pose.last_known_position().center - next.pose.last_known_position().center;
+        _speedSum += std::sqrt(derivation.x * derivation.x + derivation.y * derivation.y);
+    }
+    _speedKnown = true;
+}
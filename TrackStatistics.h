@@ -0,0 +1,85 @@
+#ifndef TRACK_STATISTICS_H
+#define TRACK_STATISTICS_H
+
+#include <biotracker/serialization/TrackedObject.h>
+
+#include "FishPose.h"
+
+// The most recent poses of one track, appended as the track grows, so the
+// TrackedFish estimators read them from here instead of copying shared
+// pointers out of the pose map. Every lookup says whether the answer is
+// exact; whatever the cache cannot vouch for (another track, frames before
+// the retained range) is Unknown and has to come from the track itself.
+//
+// add() and load() also update the sums the estimators would build over the
+// newest poses, in the same order, so those are read in O(1) per frame.
+class TrackStatistics {
+public:
+    enum Lookup { Found, Absent, Unknown };
+
+    TrackStatistics();
+
+    // forgets everything, all lookups are Unknown afterwards
+    void clear();
+    // starts caching a track that has no poses yet
+    void start(size_t id);
+    // refills from the poses an existing track has up to frame
+    void load(BioTracker::Core::TrackedObject &object, size_t frame);
+    // records the pose the track got at frame; a frame not after the last one
+    // means the history was rewritten, so the cache starts over
+    void add(size_t id, size_t frame, const FishPose &pose);
+
+    // whether the cache holds the given track up to frame
+    bool current(size_t id, size_t frame) const;
+
+    // the pose at frame
+    Lookup at(size_t id, size_t frame, const FishPose *&pose) const;
+    // the last pose before frame
+    Lookup before(size_t id, size_t frame, size_t &poseFrame, const FishPose *&pose) const;
+
+    // steps getCurrentSpeed averages over for the next pose estimate
+    static const size_t SpeedWindow = 3;
+    // estimateOrientationRad weights the k-th last step with falloff^k while
+    // that is at least the margin
+    static const float OrientationFalloff;
+    static const float OrientationFalloffMargin;
+
+    // The weighted step sum of estimateOrientationRad and its weight sum
+    // for the pose at frame; false if the cache does not decide them.
+    bool orientationSums(size_t id, size_t frame, cv::Point2f &derivative, float &weightSum) const;
+    // the summed lengths of the last SpeedWindow steps up to frame; false
+    // unless the cache holds them all
+    bool speedSum(size_t id, size_t frame, float &sum) const;
+
+private:
+    struct Entry {
+        size_t   frame;
+        FishPose pose;
+    };
+
+    // enough for estimateOrientationRad (10 poses) with room to spare
+    static const size_t Capacity = 16;
+    // frames load() looks back at most
+    static const size_t LoadWindow = 4 * Capacity;
+
+    const Entry &entry(size_t age) const;
+    // recomputes the sums for the newest entry
+    void summarize();
+
+    bool   _valid;
+    size_t _id;
+    // every pose of the track from this frame on is in _entries
+    size_t _coveredFrom;
+    Entry  _entries[Capacity];
+    // ring position of the newest entry
+    size_t _newest;
+    size_t _count;
+
+    bool        _orientationKnown;
+    cv::Point2f _derivative;
+    float       _weightSum;
+    bool        _speedKnown;
+    float       _speedSum;
+};
+
+#endif
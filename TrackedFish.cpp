@@ -2,26 +2,87 @@
 
 using namespace BioTracker::Core;
 
+namespace {
+
+// Pose lookups for the estimators, answered by the statistics where they are
+// exact and by the pose map otherwise.
+class History {
+public:
+    History(TrackedFish &fish, const TrackStatistics *statistics)
+        : _fish(fish)
+        , _statistics(statistics)
+    {}
+
+    // nullptr if there is no pose at frame
+    const FishPose *pose(size_t frame) {
+        const FishPose *cached = nullptr;
+        if (_statistics) {
+            switch (_statistics->at(_fish.getId(), frame, cached)) {
+            case TrackStatistics::Found:   return cached;
+            case TrackStatistics::Absent:  return nullptr;
+            case TrackStatistics::Unknown: break;
+            }
+        }
+        if (!_fish.hasValuesAtFrame(frame)) {
+            return nullptr;
+        }
+        // the track keeps owning the pose
+        return _fish.get<FishPose>(frame).get();
+    }
+
+    bool has(size_t frame) {
+        return pose(frame) != nullptr;
+    }
+
+    // the last pose before frame, nullptr if there is none
+    const FishPose *before(size_t frame, size_t &poseFrame) {
+        const FishPose *cached = nullptr;
+        if (_statistics) {
+            switch (_statistics->before(_fish.getId(), frame, poseFrame, cached)) {
+            case TrackStatistics::Found:   return cached;
+            case TrackStatistics::Absent:  return nullptr;
+            case TrackStatistics::Unknown: break;
+            }
+        }
+        for (size_t i = frame; i-- > 0;) {
+            if (_fish.hasValuesAtFrame(i)) {
+                poseFrame = i;
+                return _fish.get<FishPose>(i).get();
+            }
+        }
+        return nullptr;
+    }
 
-float TrackedFish::estimateOrientationRad(size_t frame, float *confidence) {
+private:
+    TrackedFish             &_fish;
+    const TrackStatistics   *_statistics;
+};
+
+}
+
+float TrackedFish::estimateOrientationRad(size_t frame, float *confidence, const TrackStatistics *statistics) {
+    History history(*this, statistics);
     // can't give estimate if not enough poses available
-    if (frame < 3 || !hasValuesAtFrame(frame) || !hasValuesAtFrame(frame - 1) ||
-        !hasValuesAtFrame(frame - 2)) return std::numeric_limits<float>::quiet_NaN();
+    if (frame < 3 || !history.has(frame) || !history.has(frame - 1) ||
+        !history.has(frame - 2)) return std::numeric_limits<float>::quiet_NaN();
 
-    cv::Point2f nextPoint = get<FishPose>(frame)->last_known_position().center;
     cv::Point2f positionDerivative(0.0f, 0.0f);
-
-    // weights the last poses with falloff^k * pose[end - k] until falloff^k < falloffMargin
-    int posesUsed = 0;
-    float currentWeight = 1.0f;
     float weightSum = 0.0f;
-    const float falloff = 0.9f;
-    const float falloffMargin = 0.4f;
 
-    for (int i = static_cast<int>(frame) - 1; i > -1; i--) {
-        if(hasValuesAtFrame(static_cast<size_t>(i))){
+    // the statistics keep the same sums up to date as poses are added
+    if (!statistics || !statistics->orientationSums(getId(), frame, positionDerivative, weightSum)) {
+        cv::Point2f nextPoint = history.pose(frame)->last_known_position().center;
+
+        // weights the last poses with falloff^k * pose[end - k] until falloff^k < falloffMargin
+        int posesUsed = 0;
+        float currentWeight = 1.0f;
+        const float falloff = TrackStatistics::OrientationFalloff;
+        const float falloffMargin = TrackStatistics::OrientationFalloffMargin;
+
+        size_t i = frame;
+        while (const FishPose *previous = history.before(i, i)) {
             // TODO: may want to use position in cm instead of pixel
-            cv::Point2f currentPoint = get<FishPose>(static_cast<size_t>(i))->last_known_position().center;
+            cv::Point2f currentPoint = previous->last_known_position().center;
             const cv::Point2f oneStepDerivative = nextPoint - currentPoint;
 
             positionDerivative += currentWeight * oneStepDerivative;
@@ -54,10 +115,11 @@ float TrackedFish::estimateOrientationRad(size_t frame, float *confidence) {
 }
 
 
-float TrackedFish::getCurrentSpeed(size_t frame, size_t smoothingWindow) {
+float TrackedFish::getCurrentSpeed(size_t frame, size_t smoothingWindow, const TrackStatistics *statistics) {
+    History history(*this, statistics);
     // don't try to estimate a speed when NO smoothing is possible
-    if (frame < 3 || !hasValuesAtFrame(frame) || !hasValuesAtFrame(frame - 1) ||
-        !hasValuesAtFrame(frame - 2) || !hasValuesAtFrame(frame - 3)) {
+    if (frame < 3 || !history.has(frame) || !history.has(frame - 1) ||
+        !history.has(frame - 2) || !history.has(frame - 3)) {
         return std::numeric_limits<float>::quiet_NaN();
     }
     // Can only smooth over max. the frames we know.
@@ -75,17 +137,23 @@ float TrackedFish::getCurrentSpeed(size_t frame, size_t smoothingWindow) {
     int totalPoints = 0;
     float totalSpeed = 0.0f;
 
-//    size_t i = getLastFrameNumber().get() - 1;
-    size_t i = frame - 1;
-    while (hasValuesAtFrame(i) && hasValuesAtFrame(i + 1)) {
-        auto currentPose = get<FishPose>(i);
-        auto nextPose = get<FishPose>(i + 1);
-        const float currentSpeed = calculateSpeed(currentPose->last_known_position().center, nextPose->last_known_position().center);
-        totalSpeed += currentSpeed;
-        i--;
-        totalPoints++;
-
-        if (--smoothingWindow == 0) break;
+    // the statistics keep the sum for the window of the next pose estimate
+    if (statistics && smoothingWindow == TrackStatistics::SpeedWindow
+            && statistics->speedSum(getId(), frame, totalSpeed)) {
+        totalPoints = static_cast<int>(smoothingWindow);
+    } else {
+//        size_t i = getLastFrameNumber().get() - 1;
+        size_t i = frame - 1;
+        while (history.has(i) && history.has(i + 1)) {
+            const FishPose *currentPose = history.pose(i);
+            const FishPose *nextPose = history.pose(i + 1);
+            const float currentSpeed = calculateSpeed(currentPose->last_known_position().center, nextPose->last_known_position().center);
+            totalSpeed += currentSpeed;
+            i--;
+            totalPoints++;
+
+            if (--smoothingWindow == 0) break;
+        }
     }
 
     // the current speed is the (non-weighted!) average over the last frames
@@ -94,50 +162,55 @@ float TrackedFish::getCurrentSpeed(size_t frame, size_t smoothingWindow) {
     return currentSpeed;
 }
 
-std::shared_ptr<FishPose> TrackedFish::estimateNextPose(size_t frame) {
+bool TrackedFish::estimateNextPose(size_t frame, cv::RotatedRect &position, float &angle,
+                                   const TrackStatistics *statistics) {
+    History history(*this, statistics);
     // can't estimate next position?
-    if (frame < 3 || !hasValuesAtFrame(frame) || !hasValuesAtFrame(frame - 1) ||
-        !hasValuesAtFrame(frame - 2) || !hasValuesAtFrame(frame - 3)) {
-        return nullptr;
+    if (frame < 3 || !history.has(frame) || !history.has(frame - 1) ||
+        !history.has(frame - 2) || !history.has(frame - 3)) {
+        return false;
     }
 
-    const auto currentPose = get<FishPose>(frame);
+    const FishPose *currentPose = history.pose(frame);
     const float currentAngle = currentPose->angle();
     const size_t smoothingWindow = 3;
-    const float currentSpeedPx = getCurrentSpeed(frame, smoothingWindow);
+    const float currentSpeedPx = getCurrentSpeed(frame, smoothingWindow, statistics);
 
     // safety!
-    if (!std::isfinite(currentAngle) || !std::isfinite(currentSpeedPx)) { return nullptr; }
+    if (!std::isfinite(currentAngle) || !std::isfinite(currentSpeedPx)) { return false; }
 
     const cv::Point2f nextPositionPx = currentPose->last_known_position().center
                                        + cv::Point2f(static_cast<float>(currentSpeedPx * std::cos(currentAngle)),
                                                      static_cast<float>(-currentSpeedPx * std::sin(currentAngle)));
-    auto retFish = std::make_shared<FishPose>(currentPose->age_of_last_known_position(),
-                                              cv::RotatedRect(nextPositionPx, currentPose->last_known_position().size, currentAngle));
-//    retFish->setNextPosition(cv::RotatedRect(nextPositionPx, currentPose->last_known_position().size, currentAngle));
-    retFish->setAngle(currentAngle);
-    return retFish;
+    position = cv::RotatedRect(nextPositionPx, currentPose->last_known_position().size, currentAngle);
+    angle = currentAngle;
+    return true;
 }
 
-FishPose& TrackedFish::getPoseForMapping(size_t frame) {
+FishPose TrackedFish::getPoseForMapping(size_t frame, const TrackStatistics *statistics) {
+    History history(*this, statistics);
     // try the estimated position first
-    std::shared_ptr<FishPose> estimated = estimateNextPose(frame);
+    cv::RotatedRect position;
+    float angle;
     // ok? then use this!
-    if (estimated.get())
+    if (estimateNextPose(frame, position, angle, statistics))
     {
-        assert(std::isfinite(estimated->last_known_position().center.x));
-        assert(std::isfinite(estimated->angle()));
-        return *estimated;
+        assert(std::isfinite(position.center.x));
+        assert(std::isfinite(angle));
+        FishPose estimated(history.pose(frame)->age_of_last_known_position(), position);
+        estimated.setAngle(angle);
+        return estimated;
     }
     // otherwise, just use the current pose
 //    assert(m_trackedObjects[trackedObjectIndex].hasValuesAtFrame(frame));
-    return *(get<FishPose>(frame));
+    return *(history.pose(frame));
 }
 
-bool TrackedFish::correctAngle(size_t frame, cv::RotatedRect &pose)
+bool TrackedFish::correctAngle(size_t frame, cv::RotatedRect &pose, const TrackStatistics *statistics)
 {
-    assert(hasValuesAtFrame(frame));
-    auto fish = get<FishPose>(frame);
+    History history(*this, statistics);
+    assert(history.has(frame));
+    const FishPose *fish = history.pose(frame);
     // the current angle is a decent estimation of the direction; however, it might point into the wrong hemisphere
     const float poseOrientation = static_cast<float>(pose.angle * CV_PI / 180.0f);
 
@@ -146,7 +219,7 @@ bool TrackedFish::correctAngle(size_t frame, cv::RotatedRect &pose)
 
     // we have more historical data to correct the new angle to at least be more plausible
     float confidence = 0.0f;
-    const float historyAngle = estimateOrientationRad(frame, &confidence);
+    const float historyAngle = estimateOrientationRad(frame, &confidence, statistics);
     const float lastConfidentAngle = fish->angle();
 
     // the current history orientation has a stronger meaning and is preferred
@@ -4,17 +4,25 @@
 #include <biotracker/serialization/TrackedObject.h>
 
 #include "FishPose.h"
+#include "TrackStatistics.h"
 
 #include <cereal/access.hpp>
 #include <opencv2/opencv.hpp>
 
+// The estimators take an optional cache of this track's recent poses. Where
+// it covers the frames involved, poses are read from there; the results are
+// the same either way.
 class TrackedFish : public BioTracker::Core::TrackedObject {
 public:
-    float estimateOrientationRad(size_t frame, float *confidence);
-    float getCurrentSpeed(size_t frame, size_t smoothingWindow);
-    std::shared_ptr<FishPose> estimateNextPose(size_t frame);
-    FishPose& getPoseForMapping(size_t frame);
-    bool correctAngle(size_t frame, cv::RotatedRect &pose);
+    float estimateOrientationRad(size_t frame, float *confidence, const TrackStatistics *statistics = nullptr);
+    float getCurrentSpeed(size_t frame, size_t smoothingWindow, const TrackStatistics *statistics = nullptr);
+    // position and orientation extrapolated from frame to frame + 1, false if
+    // the history is too short
+    bool estimateNextPose(size_t frame, cv::RotatedRect &position, float &angle,
+                          const TrackStatistics *statistics = nullptr);
+    // the estimated next pose if there is one, otherwise the pose at frame
+    FishPose getPoseForMapping(size_t frame, const TrackStatistics *statistics = nullptr);
+    bool correctAngle(size_t frame, cv::RotatedRect &pose, const TrackStatistics *statistics = nullptr);
 
 private:
     float angleDifference(float alpha, float beta);
@@ -0,0 +1,69 @@
+#include "TrackerParameters.h"
+
+TrackerParameters::TrackerParameters()
+    : numberOfObjects(6)
+    , averageSpeedPx(75.0f)
+    , polarity(ForegroundExtractor::Darker)
+    , minBlobArea(30)
+    , maxBlobArea(15000)
+    , numberOfErosions(3)
+    , numberOfDilations(1)
+    , backgroundWeight(0.95f)
+    , diffThreshold(15)
+    , framesTillPromotion(30)
+    , candidateCapacity(512)
+    , retentionWindow(512)
+    , spillArchive(false)
+    , snapshotInterval(250)
+    , segmentationThreads(0)
+    , pipelinedMapping(false)
+    , predictiveRoi(false)
+    , fullFrameInterval(25)
+    , pyramidFactor(1)
+{}
+
+bool TrackerParameters::sameSegmentation(const TrackerParameters &other) const {
+    return polarity == other.polarity
+        && minBlobArea == other.minBlobArea
+        && maxBlobArea == other.maxBlobArea
+        && numberOfErosions == other.numberOfErosions
+        && numberOfDilations == other.numberOfDilations
+        && backgroundWeight == other.backgroundWeight
+        && diffThreshold == other.diffThreshold
+        && predictiveRoi == other.predictiveRoi
+        && fullFrameInterval == other.fullFrameInterval
+        && pyramidFactor == other.pyramidFactor;
+}
+
+TrackerParameterStore::TrackerParameterStore()
+    : _sequence(0)
+{}
+
+TrackerParameters TrackerParameterStore::snapshot(size_t *version) const {
+    for (;;) {
+        const size_t before = _sequence.load(std::memory_order_acquire);
+        const TrackerParameters copy = _buffers[published(before) & 1];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const size_t after = _sequence.load(std::memory_order_relaxed);
+        // the buffer we copied is only rewritten by the second publish after
+        // 'before', which marks itself by moving the sequence to 2 * (published + 1) + 1
+        if (after < 2 * (published(before) + 1) + 1) {
+            if (version) {
+                *version = published(before);
+            }
+            return copy;
+        }
+    }
+}
+
+size_t TrackerParameterStore::version() const {
+    return published(_sequence.load(std::memory_order_acquire));
+}
+
+void TrackerParameterStore::publish(const TrackerParameters &parameters) {
+    const size_t sequence = _sequence.load(std::memory_order_relaxed);
+    _sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _buffers[(published(sequence) + 1) & 1] = parameters;
+    _sequence.store(sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,83 @@
+#ifndef TRACKER_PARAMETERS_H
+#define TRACKER_PARAMETERS_H
+
+#include <atomic>
+#include <mutex>
+
+#include "ForegroundExtractor.h"
+
+// All values the tracking pipeline reads per frame. Kept trivially copyable so
+// a snapshot is a plain memberwise copy.
+struct TrackerParameters {
+    TrackerParameters();
+
+    // true if both give the same foreground and blobs for a frame
+    bool sameSegmentation(const TrackerParameters &other) const;
+
+    size_t                          numberOfObjects;
+    float                           averageSpeedPx;
+    ForegroundExtractor::Polarity   polarity;
+    size_t                          minBlobArea;
+    size_t                          maxBlobArea;
+    size_t                          numberOfErosions;
+    size_t                          numberOfDilations;
+    float                           backgroundWeight;
+    uchar                           diffThreshold;
+    size_t                          framesTillPromotion;
+    // most fish candidates kept at once, the lowest scoring make way for new ones
+    size_t                          candidateCapacity;
+    // frames of pose history each track keeps as FishPose objects, older
+    // ones are archived in columns; 0 keeps everything as objects
+    size_t                          retentionWindow;
+    // archive to a scratch file on disk instead of in memory
+    bool                            spillArchive;
+    // frames between two snapshots of the tracking state, which seeking
+    // back resumes from; 0 = none
+    size_t                          snapshotInterval;
+    // 0 = one per cpu
+    size_t                          segmentationThreads;
+    // map on a separate thread, overlapping with segmentation of the next
+    // frame; the tracks then lag track() by up to two frames
+    bool                            pipelinedMapping;
+    // segment only around the predicted track positions
+    bool                            predictiveRoi;
+    // frames between two full-frame segmentations in predictive and
+    // coarse-to-fine mode
+    size_t                          fullFrameInterval;
+    // detect on a level downsampled by this factor and refine at full
+    // resolution, 1 = off
+    size_t                          pyramidFactor;
+};
+
+// Double-buffered parameter block. Writers (the GUI slots) publish a complete
+// copy into the inactive buffer and then flip the sequence counter; readers
+// never lock and only retry when two publishes overlap a single copy.
+class TrackerParameterStore {
+public:
+    TrackerParameterStore();
+
+    // version (if given) receives the number of publishes the snapshot reflects
+    TrackerParameters snapshot(size_t *version = nullptr) const;
+
+    // number of publishes so far; changes whenever any parameter changed
+    size_t version() const;
+
+    template <typename Modifier>
+    void update(Modifier modify) {
+        std::lock_guard<std::mutex> lock(_writeLock);
+        TrackerParameters next = _buffers[published(_sequence.load(std::memory_order_relaxed)) & 1];
+        modify(next);
+        publish(next);
+    }
+
+private:
+    static size_t published(size_t sequence) { return sequence / 2; }
+    void publish(const TrackerParameters &parameters);
+
+    TrackerParameters   _buffers[2];
+    // even: idle, odd: a writer is filling buffer (published + 1) & 1
+    std::atomic<size_t> _sequence;
+    std::mutex          _writeLock;
+};
+
+#endif
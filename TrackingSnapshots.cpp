@@ -0,0 +1,51 @@
+#include "TrackingSnapshots.h"
+
+const size_t TrackingSnapshots::Capacity;
+
+TrackingSnapshots::TrackingSnapshots()
+    : _thinning(0)
+{}
+
+bool TrackingSnapshots::due(size_t frame, size_t interval) const {
+    if (interval == 0) {
+        return false;
+    }
+    const size_t spacing = interval << _thinning;
+    return frame % spacing == 0 && (_snapshots.empty() || _snapshots.back().frame < frame);
+}
+
+TrackingSnapshots::Snapshot &TrackingSnapshots::add(size_t frame) {
+    if (_snapshots.size() >= Capacity) {
+        // keeps the newest, which the next seek most likely goes back to
+        size_t kept = 0;
+        for (size_t k = _snapshots.size() % 2 == 0 ? 1 : 0; k < _snapshots.size(); k += 2) {
+            _snapshots[kept++] = std::move(_snapshots[k]);
+        }
+        _snapshots.resize(kept);
+        _thinning++;
+    }
+    _snapshots.emplace_back();
+    Snapshot &snapshot = _snapshots.back();
+    snapshot.frame = frame;
+    return snapshot;
+}
+
+const TrackingSnapshots::Snapshot *TrackingSnapshots::before(size_t frame) const {
+    for (auto it = _snapshots.rbegin(); it != _snapshots.rend(); ++it) {
+        if (it->frame < frame) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+void TrackingSnapshots::discardFrom(size_t frame) {
+    while (!_snapshots.empty() && _snapshots.back().frame >= frame) {
+        _snapshots.pop_back();
+    }
+}
+
+void TrackingSnapshots::clear() {
+    _snapshots.clear();
+    _thinning = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef TRACKING_SNAPSHOTS_H
+#define TRACKING_SNAPSHOTS_H
+
+#include <deque>
+
+#include <opencv2/opencv.hpp>
+
+#include "Mapper.h"
+
+// Tracking state saved every few frames, so tracking can go back to the
+// snapshot before a frame and continue from there instead of starting over.
+// At most Capacity snapshots are kept; when they run out every second one is
+// dropped and the spacing doubles, so memory stays bounded on long videos.
+class TrackingSnapshots {
+public:
+    struct Snapshot {
+        // the state after this frame was tracked
+        size_t          frame;
+        cv::Mat         background;
+        cv::Mat         coarseBackground;
+        Mapper::State   mapping;
+    };
+
+    static const size_t Capacity = 64;
+
+    TrackingSnapshots();
+
+    // whether a snapshot should be taken after frame, with interval frames
+    // between two snapshots before any thinning; 0 takes none
+    bool due(size_t frame, size_t interval) const;
+
+    // snapshots have to come in increasing frame order; discardFrom() first
+    // when going back
+    Snapshot &add(size_t frame);
+
+    // the latest snapshot before frame, nullptr if there is none
+    const Snapshot *before(size_t frame) const;
+
+    // drops the snapshots of frame and later
+    void discardFrom(size_t frame);
+    void clear();
+
+private:
+    std::deque<Snapshot>    _snapshots;
+    // spacing is the interval times 2^_thinning
+    size_t                  _thinning;
+};
+
+#endif
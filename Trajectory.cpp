@@ -0,0 +1,317 @@
+#include "Trajectory.h"
+
+#include "FishCandidate.h"
+#include "PosePool.h"
+
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+struct Header {
+    uint64_t firstFrame;
+    uint64_t frames;
+    uint64_t count;
+    double   color[4];
+};
+
+// bytes per frame in the columns after the header, besides the bitmaps
+const size_t FrameBytes = 6 * sizeof(float) + sizeof(uint32_t) + sizeof(int32_t);
+
+// reads the header and checks that the columns it announces fit in size,
+// before any offset is computed from its frame count
+bool readHeader(const char *bytes, size_t size, Header &header, size_t &frames) {
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, bytes, sizeof(header));
+    // two bitmap words per 64 frames and the columns, without overflow: the
+    // bound on frames keeps every product below the payload size
+    const size_t payload = size - sizeof(header);
+    if (header.frames > payload / FrameBytes) {
+        return false;
+    }
+    frames = static_cast<size_t>(header.frames);
+    const size_t words = (frames + 63) / 64;
+    if (words > (payload - frames * FrameBytes) / (2 * sizeof(uint64_t))) {
+        return false;
+    }
+    return header.count <= header.frames
+           && header.firstFrame <= std::numeric_limits<size_t>::max() - header.frames;
+}
+
+template <class T>
+void append(std::vector<char> &bytes, const std::vector<T> &values) {
+    const char *begin = reinterpret_cast<const char *>(values.data());
+    bytes.insert(bytes.end(), begin, begin + values.size() * sizeof(T));
+}
+
+template <class T>
+T column(const char *bytes, size_t offset, size_t index) {
+    T value;
+    std::memcpy(&value, bytes + offset + index * sizeof(T), sizeof(T));
+    return value;
+}
+
+template <class T>
+bool extract(const char *&bytes, const char *end, size_t count, std::vector<T> &values) {
+    if (count > static_cast<size_t>(end - bytes) / sizeof(T)) {
+        return false;
+    }
+    values.resize(count);
+    std::memcpy(values.data(), bytes, count * sizeof(T));
+    bytes += count * sizeof(T);
+    return true;
+}
+
+}
+
+Trajectory::Trajectory()
+    : _firstFrame(0)
+    , _count(0)
+{}
+
+void Trajectory::clear() {
+    _firstFrame = 0;
+    _count = 0;
+    _valid.clear();
+    _candidate.clear();
+    _centerX.clear();
+    _centerY.clear();
+    _width.clear();
+    _height.clear();
+    _rectangleAngle.clear();
+    _angle.clear();
+    _age.clear();
+    _score.clear();
+}
+
+bool Trajectory::empty() const {
+    return _count == 0;
+}
+
+size_t Trajectory::firstFrame() const {
+    return _firstFrame;
+}
+
+size_t Trajectory::endFrame() const {
+    return _firstFrame + _centerX.size();
+}
+
+size_t Trajectory::count() const {
+    return _count;
+}
+
+void Trajectory::add(size_t frame, const FishPose &pose) {
+    if (_count == 0) {
+        clear();
+        _firstFrame = frame;
+        _color = pose.associated_color();
+    }
+    assert(frame >= _firstFrame);
+    if (frame < _firstFrame) {
+        return;
+    }
+    // frames without a pose in between keep zeros
+    const size_t index = frame - _firstFrame;
+    const size_t frames = std::max(index + 1, _centerX.size());
+    if (!bit(_valid, index)) {
+        _count++;
+    }
+    _valid.resize((frames + 63) / 64, 0);
+    _candidate.resize((frames + 63) / 64, 0);
+    _centerX.resize(frames, 0.0f);
+    _centerY.resize(frames, 0.0f);
+    _width.resize(frames, 0.0f);
+    _height.resize(frames, 0.0f);
+    _rectangleAngle.resize(frames, 0.0f);
+    _angle.resize(frames, 0.0f);
+    _age.resize(frames, 0);
+    _score.resize(frames, 0);
+
+    const cv::RotatedRect position = pose.last_known_position();
+    setBit(_valid, index);
+    clearBit(_candidate, index);
+    _centerX[index] = position.center.x;
+    _centerY[index] = position.center.y;
+    _width[index] = position.size.width;
+    _height[index] = position.size.height;
+    _rectangleAngle[index] = position.angle;
+    _angle[index] = pose.angle();
+    _age[index] = static_cast<uint32_t>(pose.age_of_last_known_position());
+    if (const FishCandidate *candidate = dynamic_cast<const FishCandidate *>(&pose)) {
+        setBit(_candidate, index);
+        _score[index] = candidate->score();
+    }
+}
+
+void Trajectory::truncate(size_t frame) {
+    if (frame >= endFrame()) {
+        return;
+    }
+    if (frame <= _firstFrame) {
+        clear();
+        return;
+    }
+    const size_t frames = frame - _firstFrame;
+    for (size_t index = frames; index < _centerX.size(); index++) {
+        if (bit(_valid, index)) {
+            _count--;
+        }
+    }
+    const size_t words = (frames + 63) / 64;
+    _valid.resize(words);
+    _candidate.resize(words);
+    // add() expects the bits past the end to be clear
+    if (frames % 64 != 0) {
+        const uint64_t mask = (uint64_t(1) << (frames % 64)) - 1;
+        _valid.back() &= mask;
+        _candidate.back() &= mask;
+    }
+    _centerX.resize(frames);
+    _centerY.resize(frames);
+    _width.resize(frames);
+    _height.resize(frames);
+    _rectangleAngle.resize(frames);
+    _angle.resize(frames);
+    _age.resize(frames);
+    _score.resize(frames);
+}
+
+bool Trajectory::hasValuesAtFrame(size_t frame) const {
+    return frame >= _firstFrame && frame < endFrame() && bit(_valid, frame - _firstFrame);
+}
+
+cv::Scalar Trajectory::color() const {
+    return _color;
+}
+
+const float *Trajectory::centerX() const {
+    return _centerX.data();
+}
+
+const float *Trajectory::centerY() const {
+    return _centerY.data();
+}
+
+const float *Trajectory::width() const {
+    return _width.data();
+}
+
+const float *Trajectory::height() const {
+    return _height.data();
+}
+
+const float *Trajectory::angle() const {
+    return _angle.data();
+}
+
+void Trajectory::serialize(std::vector<char> &bytes) const {
+    Header header;
+    header.firstFrame = _firstFrame;
+    header.frames = _centerX.size();
+    header.count = _count;
+    for (int channel = 0; channel < 4; channel++) {
+        header.color[channel] = _color[channel];
+    }
+    bytes.clear();
+    bytes.insert(bytes.end(), reinterpret_cast<const char *>(&header),
+                 reinterpret_cast<const char *>(&header) + sizeof(header));
+    append(bytes, _valid);
+    append(bytes, _candidate);
+    append(bytes, _centerX);
+    append(bytes, _centerY);
+    append(bytes, _width);
+    append(bytes, _height);
+    append(bytes, _rectangleAngle);
+    append(bytes, _angle);
+    append(bytes, _age);
+    append(bytes, _score);
+}
+
+bool Trajectory::deserialize(const char *bytes, size_t size) {
+    clear();
+    Header header;
+    size_t frames;
+    if (!readHeader(bytes, size, header, frames)) {
+        return false;
+    }
+    const char *end = bytes + size;
+    bytes += sizeof(header);
+
+    const size_t words = (frames + 63) / 64;
+    if (!extract(bytes, end, words, _valid) || !extract(bytes, end, words, _candidate) ||
+        !extract(bytes, end, frames, _centerX) || !extract(bytes, end, frames, _centerY) ||
+        !extract(bytes, end, frames, _width) || !extract(bytes, end, frames, _height) ||
+        !extract(bytes, end, frames, _rectangleAngle) || !extract(bytes, end, frames, _angle) ||
+        !extract(bytes, end, frames, _age) || !extract(bytes, end, frames, _score)) {
+        clear();
+        return false;
+    }
+    _firstFrame = static_cast<size_t>(header.firstFrame);
+    _count = static_cast<size_t>(header.count);
+    _color = cv::Scalar(header.color[0], header.color[1], header.color[2], header.color[3]);
+    return true;
+}
+
+std::shared_ptr<FishPose> Trajectory::decode(const char *bytes, size_t size, size_t frame) {
+    Header header;
+    size_t frames;
+    if (!readHeader(bytes, size, header, frames) || frame < header.firstFrame || frame - header.firstFrame >= frames) {
+        return nullptr;
+    }
+    const size_t words = (frames + 63) / 64;
+    // same layout as serialize(), readHeader() made sure it fits
+    const size_t valid = sizeof(header);
+    const size_t candidate = valid + words * sizeof(uint64_t);
+    const size_t floats = candidate + words * sizeof(uint64_t);
+    const size_t age = floats + 6 * frames * sizeof(float);
+    const size_t score = age + frames * sizeof(uint32_t);
+    const size_t index = static_cast<size_t>(frame - header.firstFrame);
+    if (!((column<uint64_t>(bytes, valid, index / 64) >> (index % 64)) & 1)) {
+        return nullptr;
+    }
+    auto field = [&](size_t number) { return column<float>(bytes, floats + number * frames * sizeof(float), index); };
+    return makePose(cv::RotatedRect(cv::Point2f(field(0), field(1)), cv::Size2f(field(2), field(3)), field(4)),
+                    field(5), column<uint32_t>(bytes, age, index),
+                    cv::Scalar(header.color[0], header.color[1], header.color[2], header.color[3]),
+                    (column<uint64_t>(bytes, candidate, index / 64) >> (index % 64)) & 1,
+                    column<int32_t>(bytes, score, index));
+}
+
+// ================ P R I V A T E ===================
+
+std::shared_ptr<FishPose> Trajectory::pose(size_t frame) const {
+    if (!hasValuesAtFrame(frame)) {
+        return nullptr;
+    }
+    const size_t index = frame - _firstFrame;
+    return makePose(cv::RotatedRect(cv::Point2f(_centerX[index], _centerY[index]),
+                                    cv::Size2f(_width[index], _height[index]),
+                                    _rectangleAngle[index]),
+                    _angle[index], _age[index], _color, bit(_candidate, index), _score[index]);
+}
+
+std::shared_ptr<FishPose> Trajectory::makePose(const cv::RotatedRect &position, float angle, uint32_t age,
+                                               const cv::Scalar &color, bool candidate, int32_t score) {
+    FishPose pose(age, position);
+    pose.setAngle(angle);
+    pose.set_associated_color(color);
+    if (candidate) {
+        return allocatePose<FishCandidate>(pose, score);
+    }
+    return allocatePose<FishPose>(pose);
+}
+
+bool Trajectory::bit(const std::vector<uint64_t> &bits, size_t index) {
+    return index / 64 < bits.size() && ((bits[index / 64] >> (index % 64)) & 1);
+}
+
+void Trajectory::setBit(std::vector<uint64_t> &bits, size_t index) {
+    bits[index / 64] |= uint64_t(1) << (index % 64);
+}
+
+void Trajectory::clearBit(std::vector<uint64_t> &bits, size_t index) {
+    bits[index / 64] &= ~(uint64_t(1) << (index % 64));
+}
@@ -0,0 +1,89 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "FishPose.h"
+
+// Pose history of one track in columns: a contiguous array per field over a
+// run of frames, a bitmap of the frames that have a pose, and the colour,
+// which never changes along a track, stored once. That is 32 bytes and two
+// bits per frame, against well over 100 bytes for a FishPose behind a
+// shared_ptr in a map, and a scan over one field only touches that field.
+// get<T>() hands out poses like TrackedObject::get<T>().
+class Trajectory {
+public:
+    Trajectory();
+
+    void clear();
+    bool empty() const;
+
+    // frames covered, [firstFrame(), endFrame())
+    size_t firstFrame() const;
+    size_t endFrame() const;
+    // frames with a pose
+    size_t count() const;
+
+    // replaces the pose if frame already has one; frames before firstFrame()
+    // cannot be added. The colour is taken from the first pose.
+    void add(size_t frame, const FishPose &pose);
+    // drops the poses from frame on
+    void truncate(size_t frame);
+
+    bool hasValuesAtFrame(size_t frame) const;
+    // a newly allocated FishPose (or FishCandidate) for frame, nullptr if
+    // there is none or it is not a T
+    template <class T>
+    std::shared_ptr<T> get(size_t frame) const {
+        return std::dynamic_pointer_cast<T>(pose(frame));
+    }
+
+    cv::Scalar color() const;
+    // one value per frame from firstFrame(), meaningless where there is no pose
+    const float *centerX() const;
+    const float *centerY() const;
+    const float *width() const;
+    const float *height() const;
+    const float *angle() const;
+
+    // flat byte image in host byte order; TrajectoryFile marks the order in
+    // its header, it is not portable on its own
+    void serialize(std::vector<char> &bytes) const;
+    bool deserialize(const char *bytes, size_t size);
+    // the pose at frame straight from a serialized image, without copying the
+    // columns; nullptr if there is none or the image is damaged
+    static std::shared_ptr<FishPose> decode(const char *bytes, size_t size, size_t frame);
+
+private:
+    std::shared_ptr<FishPose> pose(size_t frame) const;
+    static std::shared_ptr<FishPose> makePose(const cv::RotatedRect &position, float angle, uint32_t age,
+                                              const cv::Scalar &color, bool candidate, int32_t score);
+
+    static bool bit(const std::vector<uint64_t> &bits, size_t index);
+    static void setBit(std::vector<uint64_t> &bits, size_t index);
+    static void clearBit(std::vector<uint64_t> &bits, size_t index);
+
+    size_t                  _firstFrame;
+    size_t                  _count;
+    cv::Scalar              _color;
+
+    std::vector<uint64_t>   _valid;
+    // frames whose pose is a FishCandidate (the history before promotion)
+    std::vector<uint64_t>   _candidate;
+    std::vector<float>      _centerX;
+    std::vector<float>      _centerY;
+    std::vector<float>      _width;
+    std::vector<float>      _height;
+    // RotatedRect angle in degrees, as measured
+    std::vector<float>      _rectangleAngle;
+    // FishPose::angle in radians
+    std::vector<float>      _angle;
+    std::vector<uint32_t>   _age;
+    std::vector<int32_t>    _score;
+};
+
+#endif
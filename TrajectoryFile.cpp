@@ -0,0 +1,214 @@
+#include "TrajectoryFile.h"
+
+#include <QSaveFile>
+
+#include <cereal/archives/json.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <cstring>
+#include <fstream>
+
+using namespace BioTracker::Core;
+
+const char TrajectoryFile::Magic[8] = {'S', 'T', 'R', 'A', 'J', 'E', 'C', 'T'};
+const uint32_t TrajectoryFile::ByteOrderMark;
+
+TrajectoryFile::TrajectoryFile()
+    : _data(nullptr)
+    , _size(0)
+{}
+
+TrajectoryFile::~TrajectoryFile() {
+    close();
+}
+
+bool TrajectoryFile::write(const QString &path, std::vector<TrackedObject> &objects) {
+    Trajectory trajectory;
+    return write(path, objects.size(), [&](size_t track, size_t &id) -> const Trajectory & {
+        TrackedObject &object = objects[track];
+        trajectory.clear();
+        const boost::optional<size_t> lastFrame = object.getLastFrameNumber();
+        if (lastFrame) {
+            for (size_t frame = 0; frame <= lastFrame.get(); frame++) {
+                if (object.hasValuesAtFrame(frame)) {
+                    trajectory.add(frame, *object.get<FishPose>(frame));
+                }
+            }
+        }
+        id = object.getId();
+        return trajectory;
+    });
+}
+
+bool TrajectoryFile::write(const QString &path, const std::vector<size_t> &ids, const std::vector<Trajectory> &trajectories) {
+    return write(path, trajectories.size(), [&](size_t track, size_t &id) -> const Trajectory & {
+        id = ids[track];
+        return trajectories[track];
+    });
+}
+
+bool TrajectoryFile::open(const QString &path) {
+    close();
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    _size = static_cast<size_t>(_file.size());
+    _data = reinterpret_cast<const char *>(_file.map(0, _file.size()));
+
+    Header header;
+    if (!_data || _size < sizeof(header)) {
+        close();
+        return false;
+    }
+    std::memcpy(&header, _data, sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.byteOrder != ByteOrderMark ||
+        header.version != Version ||
+        (_size - sizeof(header)) / sizeof(IndexEntry) < header.tracks) {
+        close();
+        return false;
+    }
+    _index.resize(static_cast<size_t>(header.tracks));
+    if (!_index.empty()) {
+        std::memcpy(_index.data(), _data + sizeof(header), _index.size() * sizeof(IndexEntry));
+    }
+    for (const IndexEntry &entry : _index) {
+        if (entry.offset > _size || entry.size > _size - entry.offset) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void TrajectoryFile::close() {
+    if (_data) {
+        _file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(_data)));
+    }
+    _file.close();
+    _data = nullptr;
+    _size = 0;
+    _index.clear();
+}
+
+bool TrajectoryFile::isOpen() const {
+    return _data != nullptr;
+}
+
+size_t TrajectoryFile::trackCount() const {
+    return _index.size();
+}
+
+size_t TrajectoryFile::trackId(size_t track) const {
+    return static_cast<size_t>(_index[track].id);
+}
+
+size_t TrajectoryFile::firstFrame(size_t track) const {
+    return static_cast<size_t>(_index[track].firstFrame);
+}
+
+size_t TrajectoryFile::endFrame(size_t track) const {
+    return static_cast<size_t>(_index[track].endFrame);
+}
+
+std::shared_ptr<FishPose> TrajectoryFile::pose(size_t track, size_t frame) const {
+    const IndexEntry &entry = _index[track];
+    return Trajectory::decode(_data + entry.offset, static_cast<size_t>(entry.size), frame);
+}
+
+bool TrajectoryFile::trajectory(size_t track, Trajectory &trajectory) const {
+    const IndexEntry &entry = _index[track];
+    return trajectory.deserialize(_data + entry.offset, static_cast<size_t>(entry.size));
+}
+
+bool TrajectoryFile::read(std::vector<TrackedObject> &objects) const {
+    objects.clear();
+    objects.reserve(_index.size());
+    Trajectory trajectory;
+    for (size_t track = 0; track < _index.size(); track++) {
+        if (!this->trajectory(track, trajectory)) {
+            return false;
+        }
+        TrackedObject object(static_cast<size_t>(_index[track].id));
+        for (size_t frame = trajectory.firstFrame(); frame < trajectory.endFrame(); frame++) {
+            if (trajectory.hasValuesAtFrame(frame)) {
+                object.add(frame, trajectory.get<FishPose>(frame));
+            }
+        }
+        objects.push_back(std::move(object));
+    }
+    return true;
+}
+
+bool TrajectoryFile::writeJson(const QString &path, std::vector<TrackedObject> &objects) {
+    std::ofstream stream(path.toStdString());
+    if (!stream) {
+        return false;
+    }
+    {
+        cereal::JSONOutputArchive archive(stream);
+        archive(cereal::make_nvp("trackedObjects", objects));
+    }
+    return static_cast<bool>(stream);
+}
+
+bool TrajectoryFile::readJson(const QString &path, std::vector<TrackedObject> &objects) {
+    std::ifstream stream(path.toStdString());
+    if (!stream) {
+        return false;
+    }
+    try {
+        cereal::JSONInputArchive archive(stream);
+        archive(cereal::make_nvp("trackedObjects", objects));
+    } catch (const cereal::Exception &) {
+        return false;
+    }
+    return true;
+}
+
+// ================ P R I V A T E ===================
+
+bool TrajectoryFile::write(const QString &path, size_t tracks, const TrackSource &source) {
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrder = ByteOrderMark;
+    header.tracks = tracks;
+    std::vector<IndexEntry> index(tracks);
+
+    // blocks follow the index, each starting 8 byte aligned
+    uint64_t offset = sizeof(Header) + index.size() * sizeof(IndexEntry);
+    if (!file.seek(static_cast<qint64>(offset))) {
+        return false;
+    }
+    std::vector<char> bytes;
+    for (size_t i = 0; i < tracks; i++) {
+        size_t id = 0;
+        const Trajectory &trajectory = source(i, id);
+        trajectory.serialize(bytes);
+        bytes.resize((bytes.size() + 7) / 8 * 8, 0);
+
+        index[i].id = id;
+        index[i].firstFrame = trajectory.firstFrame();
+        index[i].endFrame = trajectory.endFrame();
+        index[i].offset = offset;
+        index[i].size = bytes.size();
+        if (file.write(bytes.data(), static_cast<qint64>(bytes.size())) != static_cast<qint64>(bytes.size())) {
+            return false;
+        }
+        offset += bytes.size();
+    }
+
+    const qint64 indexBytes = static_cast<qint64>(index.size() * sizeof(IndexEntry));
+    if (!file.seek(0) ||
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header) ||
+        file.write(reinterpret_cast<const char *>(index.data()), indexBytes) != indexBytes) {
+        return false;
+    }
+    return file.commit();
+}
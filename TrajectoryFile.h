@@ -0,0 +1,87 @@
+#ifndef TRAJECTORY_FILE_H
+#define TRAJECTORY_FILE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <QFile>
+#include <QString>
+
+#include <biotracker/serialization/TrackedObject.h>
+
+#include "FishPose.h"
+#include "Trajectory.h"
+
+// Binary trajectory file: a header with magic, version and byte order, an
+// index with the id, frame range and block location of every track, and one
+// columnar Trajectory block per track. Everything is in the byte order of the
+// machine that wrote the file; open() refuses files of the other one. open() maps the file and reads nothing but the
+// index; poses are decoded from the mapped columns when asked for, so a
+// single frame of a long session costs the same as one of a short one.
+// The cereal JSON archives of the tracked objects stay the interchange
+// format, readJson()/writeJson() convert between the two.
+class TrajectoryFile {
+public:
+    static const uint32_t Version = 2;
+
+    TrajectoryFile();
+    ~TrajectoryFile();
+
+    static bool write(const QString &path, std::vector<BioTracker::Core::TrackedObject> &objects);
+    // tracks that are already in columns, ids[i] belonging to trajectories[i]
+    static bool write(const QString &path, const std::vector<size_t> &ids, const std::vector<Trajectory> &trajectories);
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+
+    size_t trackCount() const;
+    size_t trackId(size_t track) const;
+    // frames covered by a track, [firstFrame, endFrame)
+    size_t firstFrame(size_t track) const;
+    size_t endFrame(size_t track) const;
+
+    // nullptr if the track has no pose at frame
+    std::shared_ptr<FishPose> pose(size_t track, size_t frame) const;
+    // all poses of a track at once
+    bool trajectory(size_t track, Trajectory &trajectory) const;
+
+    // every track as a TrackedObject, replacing the contents of objects
+    bool read(std::vector<BioTracker::Core::TrackedObject> &objects) const;
+
+    static bool writeJson(const QString &path, std::vector<BioTracker::Core::TrackedObject> &objects);
+    static bool readJson(const QString &path, std::vector<BioTracker::Core::TrackedObject> &objects);
+
+private:
+    struct Header {
+        char     magic[8];
+        uint32_t version;
+        // ByteOrderMark as the writer stored it
+        uint32_t byteOrder;
+        uint64_t tracks;
+    };
+
+    struct IndexEntry {
+        uint64_t id;
+        uint64_t firstFrame;
+        uint64_t endFrame;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    static const char Magic[8];
+    static const uint32_t ByteOrderMark = 0x01020304;
+
+    // the trajectory of track number track, its id stored in id
+    typedef std::function<const Trajectory &(size_t track, size_t &id)> TrackSource;
+    static bool write(const QString &path, size_t tracks, const TrackSource &source);
+
+    QFile                   _file;
+    const char             *_data;
+    size_t                  _size;
+    std::vector<IndexEntry> _index;
+};
+
+#endif